@@ -2,81 +2,358 @@
 #include <iostream>
 #include <random>
 #include <cmath>
-#include <set>
 #include <algorithm>
 #include <queue>
+#include <cstring>
+#include <limits>
 #include "global_functions.h"  // Make sure this contains the computeDPrime function
+#include "cpu_features.h"
+
+// Hamming distances between the query sketch and the sketches of the given rows, `words` 64-bit words each
+using HammingKernel = void (*)(const std::uint64_t* sketches, int words, const int* rows, std::size_t count,
+                               const std::uint64_t* query, int* out);
+
+// The loop shared by both kernels. It is inlined into each, so it is compiled for the caller's target.
+__attribute__((always_inline))
+static inline void hammingDistancesLoop(const std::uint64_t* sketches, int words, const int* rows, std::size_t count,
+                                        const std::uint64_t* query, int* out) {
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint64_t* sketch = sketches + static_cast<std::size_t>(rows[i]) * words;
+        int distance = 0;
+        for (int w = 0; w < words; ++w) {
+            distance += __builtin_popcountll(sketch[w] ^ query[w]);
+        }
+        out[i] = distance;
+    }
+}
+
+static void hammingDistancesScalar(const std::uint64_t* sketches, int words, const int* rows, std::size_t count,
+                                   const std::uint64_t* query, int* out) {
+    hammingDistancesLoop(sketches, words, rows, count, query, out);
+}
+
+#ifdef K23_X86
+
+// The target lets the compiler use the POPCNT instruction instead of a bit-twiddling routine
+__attribute__((target("popcnt")))
+static void hammingDistancesPopcnt(const std::uint64_t* sketches, int words, const int* rows, std::size_t count,
+                                   const std::uint64_t* query, int* out) {
+    hammingDistancesLoop(sketches, words, rows, count, query, out);
+}
 
-Hypercube::Hypercube(std::vector<std::vector<unsigned char>> dataset,
+#endif
+
+static HammingKernel selectedHammingKernel() {
+    static const HammingKernel selected = [] {
+#ifdef K23_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("popcnt")) {
+            return &hammingDistancesPopcnt;
+        }
+#endif
+        return &hammingDistancesScalar;
+    }();
+    return selected;
+}
+
+Hypercube::Hypercube(DatasetView dataset,
                      int k,int M,int probes,
-                     int N, double R)
-        : dataset(std::move(dataset)),
+                     int N, double R, unsigned int seed, double bucket_width,
+                     HashArithmetic arithmetic, int num_threads)
+        : shared_dataset(dataset),
+          dataset(dataset),
           k(k),
-          M(M),probes(probes),
+          num_dimensions(static_cast<int>(dataset.dimension())),
           N(N), R(R),
-          table_functions(createHashFunctions(k, computeDPrime(n)))
+          M(M),
+          n(static_cast<int>(dataset.size())),
+          probes(probes),num_threads(num_threads),
+          arithmetic(arithmetic)
 {
-    generator = std::mt19937(std::random_device{}());
-    reduced_dimension = computeDPrime(n);
+    if (dataset.empty() || num_dimensions == 0) {
+        throw std::invalid_argument("Dataset is empty.");
+    }
+    generator = std::mt19937(seed);
+    // d' is drawn once and shared by the projection matrix and the hash functions
+    reduced_dimension = std::max(1, computeDPrime(n, generator));
     //std::cout << "Reduced dimension: " << reduced_dimension << std::endl;
-    // Resize the hash_table for 2^k buckets, each initialized with an empty vector
-    hash_table.resize(1 << k);
 
     // Create the random projection matrix
     std::normal_distribution<float> distribution(0.0, 1.0);
-    for (int i = 0; i < reduced_dimension; ++i) {
-        std::vector<float> v;
-        for (int j = 0; j < num_dimensions; ++j) {
-            v.push_back(distribution(generator));
-        }
-        random_projection_matrix.push_back(v);
+    random_projection_matrix.resize(static_cast<std::size_t>(reduced_dimension) * num_dimensions);
+    for (float& weight : random_projection_matrix) {
+        weight = distribution(generator);
     }
+    quantized_projection = quantizeMatrix(random_projection_matrix.data(), reduced_dimension, num_dimensions);
 
     std::uniform_real_distribution<double> w_distribution(400, 500);
     w = w_distribution(generator);
+    if (bucket_width > 0) {
+        w = bucket_width;
+    }
+
+    // The offsets are drawn from [0, w), so w has to be known first. Everything drawn so far is
+    // independent of k, so rebuild() redraws the functions from this same state.
+    function_generator = generator;
+    createHashFunctions();
 
     buildIndex();
 
 }
 
-Hypercube::~Hypercube() {
-    table_functions.clear();
-}
+Hypercube::~Hypercube() = default;
 
 void Hypercube::buildIndex() {
-    for (int i = 0; i < dataset.size(); ++i) {
-        int id = computeID(dataset[i]);
-        hash_table[id].push_back(i);
-    }
-}
-
-std::vector<int> Hypercube::probe(const std::vector<unsigned char>& query_point, int maxProbes) {
-    //std::cout << "Hi" << std::endl;
-    int hash_value = computeID(query_point);
-    //std::cout << "hash_value: " << hash_value << std::endl;
-    std::set<int> candidates;
-    int vertices_checked = 0;
-    int distance = 0;
-
-    //std::cout << "maxProbes: " << maxProbes << std::endl;
-    //std::cout << "vertices_checked: " << vertices_checked << std::endl;
-
-    while(vertices_checked < maxProbes) {
-        for (int i = 0; i < k && vertices_checked < maxProbes; ++i) {
-            int neighbor_hash = hash_value ^ (1 << i);
-            //std::cout << "Hello" << std::endl;
-            // print hash_table[neighbor_hash]
-            //std::cout << "hash_table[neighbor_hash].size(): " << hash_table[neighbor_hash].size() << std::endl;
-            for(int idx : hash_table[neighbor_hash]) {
-                //std::cout << "idx: " << idx << std::endl;
-                candidates.insert(idx);
+    // The dataset is projected in blocks of points spread over the threads, and the projections are kept
+    // for rebuilds. Every block writes its own rows, so no locking.
+    reduced_points.resize(static_cast<std::size_t>(n) * reduced_dimension);
+    parallelFor(n, 256, num_threads, [&](std::size_t begin, std::size_t end) {
+        float* out = reduced_points.data() + begin * reduced_dimension;
+        if (arithmetic == HashArithmetic::Quantized) {
+            projectPointsQuantized(quantized_projection, dataset, begin, end, out);
+        } else {
+            projectPoints(random_projection_matrix.data(), reduced_dimension, num_dimensions, dataset, begin, end,
+                          out);
+        }
+    });
+    assignVertices();
+}
+
+void Hypercube::assignVertices() {
+    vertices.resize(n);
+    parallelFor(n, 1024, num_threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            vertices[i] = idFromReduced(reducedRow(static_cast<int>(i)));
+        }
+    });
+
+    // Counting sort of the rows into the buckets, by one thread in row order, so the layout does not
+    // depend on the thread count
+    bucket_offsets.assign((std::size_t{1} << k) + 1, 0);
+    for (int vertex : vertices) {
+        ++bucket_offsets[vertex + 1];
+    }
+    for (std::size_t v = 1; v < bucket_offsets.size(); ++v) {
+        bucket_offsets[v] += bucket_offsets[v - 1];
+    }
+    bucket_points.resize(n);
+    std::vector<int> fill(bucket_offsets.begin(), bucket_offsets.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        bucket_points[fill[vertices[i]]++] = i;
+    }
+
+    // Combination table for Hamming-ball probing: for d = 0..k, every k-bit mask with d bits set
+    // (Gosper's hack walks them in increasing order)
+    probe_masks.clear();
+    probe_masks.reserve(std::size_t{1} << k);
+    probe_masks.push_back(0);
+    for (int d = 1; d <= k; ++d) {
+        for (unsigned mask = (1u << d) - 1; mask < (1u << k);) {
+            probe_masks.push_back(static_cast<int>(mask));
+            unsigned lowest = mask & (~mask + 1);
+            unsigned ripple = mask + lowest;
+            mask = ripple | (((mask ^ ripple) >> 2) / lowest);
+        }
+    }
+}
+
+void Hypercube::rebuild(int k_) {
+    k = k_;
+    createHashFunctions();
+    assignVertices();
+}
+
+void Hypercube::reorder() {
+    // Row r of the new order is the bucket_points[r] of the old one: all buckets, one after the other
+    Dataset sorted(n, num_dimensions);
+    std::vector<float> sorted_reduced(reduced_points.size());
+    std::vector<int> sorted_ids(n);
+    std::vector<std::uint64_t> sorted_sketches(sketches.size());
+    for (int r = 0; r < n; ++r) {
+        const int old_row = bucket_points[r];
+        std::copy_n(sketches.data() + static_cast<std::size_t>(old_row) * sketch_words, sketch_words,
+                    sorted_sketches.data() + static_cast<std::size_t>(r) * sketch_words);
+        std::memcpy(sorted.mutableRow(r), dataset.row(old_row), num_dimensions);
+        std::copy_n(reducedRow(old_row), reduced_dimension,
+                    sorted_reduced.data() + static_cast<std::size_t>(r) * reduced_dimension);
+        sorted_ids[r] = originalId(old_row);
+    }
+
+    // Other indexes may hold views of the shared rows, so they stay where they are
+    reordered_rows = std::move(sorted);
+    dataset = reordered_rows.view();
+    reduced_points = std::move(sorted_reduced);
+    sketches = std::move(sorted_sketches);
+    original_ids = std::move(sorted_ids);
+    rows_by_id.resize(n);
+    for (int r = 0; r < n; ++r) {
+        rows_by_id[original_ids[r]] = r;
+    }
+    assignVertices();
+}
+
+void Hypercube::useSketches(int bits) {
+    if (bits < 0 || bits % 64 != 0) {
+        throw std::invalid_argument("Sketch bits must be a multiple of 64.");
+    }
+    sketch_words = bits / 64;
+    if (bits == 0) {
+        sketch_projections.clear();
+        sketch_thresholds.clear();
+        sketches.clear();
+        return;
+    }
+
+    std::normal_distribution<float> distribution(0.0, 1.0);
+    sketch_projections.resize(static_cast<std::size_t>(bits) * num_dimensions);
+    for (float& weight : sketch_projections) {
+        weight = distribution(generator);
+    }
+
+    // Centering on the mean makes every bit split the data roughly in half. By linearity, comparing a
+    // point's projection with the mean's is the same as taking the sign of the centered projection.
+    std::vector<double> mean(num_dimensions, 0.0);
+    for (int i = 0; i < n; ++i) {
+        const unsigned char* row = dataset.row(i);
+        for (int j = 0; j < num_dimensions; ++j) {
+            mean[j] += row[j];
+        }
+    }
+    sketch_thresholds.resize(bits);
+    for (int r = 0; r < bits; ++r) {
+        const float* weights = sketch_projections.data() + static_cast<std::size_t>(r) * num_dimensions;
+        double threshold = 0.0;
+        for (int j = 0; j < num_dimensions; ++j) {
+            threshold += weights[j] * mean[j];
+        }
+        sketch_thresholds[r] = static_cast<float>(threshold / n);
+    }
+
+    sketches.assign(static_cast<std::size_t>(n) * sketch_words, 0);
+    parallelFor(n, 256, num_threads, [&](std::size_t begin, std::size_t end) {
+        std::vector<float> projections((end - begin) * bits);
+        projectPoints(sketch_projections.data(), bits, num_dimensions, dataset, begin, end, projections.data());
+        for (std::size_t i = begin; i < end; ++i) {
+            sketchFromProjections(projections.data() + (i - begin) * bits, sketches.data() + i * sketch_words);
+        }
+    });
+}
+
+void Hypercube::sketchFromProjections(const float* projections, std::uint64_t* sketch) const {
+    for (int w = 0; w < sketch_words; ++w) {
+        std::uint64_t bits = 0;
+        for (int b = 0; b < 64; ++b) {
+            bits |= static_cast<std::uint64_t>(projections[w * 64 + b] > sketch_thresholds[w * 64 + b]) << b;
+        }
+        sketch[w] = bits;
+    }
+}
+
+std::size_t Hypercube::candidateLimit() const {
+    // With sketches, the whole vertex budget is gathered and the sketches pick the M to measure
+    if (sketch_words > 0) {
+        return std::numeric_limits<std::size_t>::max();
+    }
+    return static_cast<std::size_t>(std::max(M, 0));
+}
+
+void Hypercube::selectCandidates(const unsigned char* query_point, std::vector<int>& candidates) const {
+    if (candidates.size() <= static_cast<std::size_t>(M)) {
+        return;
+    }
+    if (sketch_words == 0) {
+        candidates.resize(M);
+        return;
+    }
+
+    const int bits = sketch_words * 64;
+    thread_local std::vector<float> projections;
+    thread_local std::vector<std::uint64_t> query_sketch;
+    thread_local std::vector<int> distances;
+    thread_local std::vector<std::pair<int, int>> ranked; // (sketch distance, candidate)
+    projections.resize(bits);
+    query_sketch.resize(sketch_words);
+    projectPoint(sketch_projections.data(), bits, num_dimensions, query_point, projections.data());
+    sketchFromProjections(projections.data(), query_sketch.data());
+
+    distances.resize(candidates.size());
+    selectedHammingKernel()(sketches.data(), sketch_words, candidates.data(), candidates.size(),
+                            query_sketch.data(), distances.data());
+    ranked.resize(candidates.size());
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        ranked[i] = {distances[i], candidates[i]};
+    }
+
+    // The M nearest sketches are measured in row order: walking the rows forward keeps the hardware
+    // prefetcher ahead of the scan, which matters more than visiting the closest sketches first
+    std::nth_element(ranked.begin(), ranked.begin() + M, ranked.end());
+    candidates.resize(M);
+    for (int i = 0; i < M; ++i) {
+        candidates[i] = ranked[i].second;
+    }
+    std::sort(candidates.begin(), candidates.end());
+}
+
+int Hypercube::originalId(int row) const {
+    return original_ids.empty() ? row : original_ids[row];
+}
+
+void Hypercube::probe(const unsigned char* query_point, int maxProbes, std::size_t candidate_limit,
+                      std::vector<int>& candidates) const {
+    thread_local std::vector<float> reduced;
+    reduced.resize(reduced_dimension);
+    reduceDimensionality(query_point, arithmetic, reduced.data());
+    std::vector<double> positions(k);
+    slotPositions(reduced.data(), positions.data());
+    int hash_value = 0;
+    for (int i = 0; i < k; ++i) {
+        hash_value |= fi(static_cast<int>(std::floor(positions[i])) + 100000) << i;
+    }
+
+    // Candidates in probe order; the visited set drops the ones already gathered
+    thread_local VisitedSet visited;
+    visited.clear(dataset.size());
+    candidates.clear();
+    auto visitVertex = [&](int vertex) {
+        for (int b = bucket_offsets[vertex]; b < bucket_offsets[vertex + 1] && candidates.size() < candidate_limit;
+             ++b) {
+            const int idx = bucket_points[b];
+            if (visited.insert(idx)) {
+                candidates.push_back(idx);
             }
-            vertices_checked++;
         }
-        distance++; // This increases the Hamming distance, but remember, you might want to constrain this if it goes beyond the bounds of your hypercube.
+    };
+
+    // Probing stops at the vertex budget or as soon as enough candidates are in, whichever comes first,
+    // so sparse neighbourhoods are searched wider and dense ones are not searched further than needed
+    const int vertex_count = std::min<int>(maxProbes, static_cast<int>(probe_masks.size()));
+    if (probe_order == ProbeOrder::HammingBall) {
+        for (int p = 0; p < vertex_count && candidates.size() < candidate_limit; ++p) {
+            visitVertex(hash_value ^ probe_masks[p]);
+        }
+        return;
     }
 
-    return {candidates.begin(), candidates.end()};
+    // Query-directed: flipping bit i costs the squared distance (in slot widths) from the query's
+    // projection to the nearest slot boundary; vertices come in increasing total cost
+    std::vector<double> scores(k);
+    for (int i = 0; i < k; ++i) {
+        double fraction = positions[i] - std::floor(positions[i]);
+        double distance = std::min(fraction, 1 - fraction);
+        scores[i] = distance * distance;
+    }
+    PerturbationSequence flips(scores);
+    std::vector<int> subset;
+    if (vertex_count > 0) {
+        visitVertex(hash_value);
+    }
+    for (int p = 1; p < vertex_count && candidates.size() < candidate_limit && flips.next(subset); ++p) {
+        int mask = 0;
+        for (int bit : subset) {
+            mask |= 1 << bit;
+        }
+        visitVertex(hash_value ^ mask);
+    }
 }
 
 
@@ -86,133 +363,186 @@ int Hypercube::fi(int hi_value) {
     return hi_value % 2;
 }
 
-int Hypercube::computeID(const std::vector<unsigned char>& data_point) {
-
-    // << "Hey!" << std::endl;
-    auto reduced_data_point = reduceDimensionality(data_point);
+int Hypercube::idFromReduced(const float* reduced_data_point) const {
     //std::cout << "Hey!!!" << std::endl;
 
-    if (reduced_data_point.size() != reduced_dimension) {
-        throw std::runtime_error("Reduced data point dimensions mismatch.");
+    std::vector<double> positions(k);
+    slotPositions(reduced_data_point, positions.data());
+    int g_value = 0;
+    for (int i = 0; i < k; ++i) {
+        int hi = static_cast<int>(std::floor(positions[i]));
+        hi += 100000;
+        g_value |= (fi(hi) << i);
     }
+    return g_value;
 
-    int g_value = 0;
+}
+
+void Hypercube::slotPositions(const float* reduced_data_point, double* positions) const {
     for (int i = 0; i < k; ++i) {
-        auto& [v, t] = table_functions[i];
+        const float* v = function_vectors.data() + static_cast<std::size_t>(i) * reduced_dimension;
         double dot_product = 0.0;
         for (int j = 0; j < reduced_dimension; ++j) {
             dot_product += v[j] * reduced_data_point[j];
         }
-        int hi = static_cast<int>(std::floor((dot_product + t) / w));
-        hi += 100000;
-        g_value |= (fi(hi) << i);
+        positions[i] = (dot_product + function_offsets[i]) / w;
     }
-    return g_value;
-
 }
 
-std::vector<std::pair<std::vector<float>, float>> Hypercube::createHashFunctions(int k_, int dim) {
-    std::vector<std::pair<std::vector<float>, float>> table_functions_;
+void Hypercube::createHashFunctions() {
+    std::mt19937 function_draws = function_generator;
     std::normal_distribution<float> distribution(0.0, 1.0);
     std::uniform_real_distribution<float> offset_distribution(0.0, w);
 
-    for (int i = 0; i < k_; ++i) {
-        std::vector<float> v;
-        for (int j = 0; j < dim; ++j) {
-            v.push_back(distribution(generator));
+    function_vectors.resize(static_cast<std::size_t>(k) * reduced_dimension);
+    function_offsets.resize(k);
+    for (int i = 0; i < k; ++i) {
+        for (int j = 0; j < reduced_dimension; ++j) {
+            function_vectors[static_cast<std::size_t>(i) * reduced_dimension + j] = distribution(function_draws);
         }
-        float t = offset_distribution(generator);
-        table_functions_.emplace_back(v, t);
+        function_offsets[i] = offset_distribution(function_draws);
     }
+}
 
-    return table_functions_;
+std::vector<std::pair<int, double>> Hypercube::kNearestNeighbors(const unsigned char* q, int K) const {
+    std::vector<int> candidateIndices;
+    return kNearestNeighbors(q, K, candidateIndices);
 }
 
-std::vector<std::pair<int, double>> Hypercube::kNearestNeighbors(const std::vector<unsigned char>& q,int K) {
-    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<>> nearest_neighbors_queue;
-    std::vector<int> candidateIndices = probe(q, probes); // IT WAS k not probes
+std::vector<std::pair<int, double>> Hypercube::kNearestNeighbors(const unsigned char* q, int K,
+                                                                 std::vector<int>& candidateIndices) const {
+    TopKHeap nearest_neighbors(K);
+    probe(q, probes, candidateLimit(), candidateIndices); // IT WAS k not probes
 
 
-    int checkedCandidates = 0;
-    for (const auto& index : candidateIndices) {
-        if (checkedCandidates >= M) {
-            break;
+    // At most M candidates are checked; those farther than the current K-th best are abandoned part-way through
+    selectCandidates(q, candidateIndices);
+    scanCandidates(dataset, q, candidateIndices, nearest_neighbors);
+
+    auto results = nearest_neighbors.sortedResults();
+    if (!original_ids.empty()) {
+        for (auto& result : results) {
+            result.first = original_ids[result.first];
         }
-        double distance = euclideanDistance(dataset[index], q);
-        nearest_neighbors_queue.emplace(distance, index);
-        checkedCandidates++;
     }
+    return results;
+}
 
-    std::vector<std::pair<int, double>> nearest_neighbors;
-
-    int count = 0;
-    while (!nearest_neighbors_queue.empty() && count < K) {
-        nearest_neighbors.emplace_back(nearest_neighbors_queue.top().second, nearest_neighbors_queue.top().first);
-        nearest_neighbors_queue.pop();
-        count++;
+void Hypercube::candidates(const unsigned char* q, std::vector<int>& out) const {
+    probe(q, probes, candidateLimit(), out);
+    selectCandidates(q, out);
+    if (!original_ids.empty()) {
+        for (int& index : out) {
+            index = original_ids[index];
+        }
     }
+}
 
-    return nearest_neighbors;
+std::vector<std::vector<std::pair<int, double>>> Hypercube::kNearestNeighborsBatch(DatasetView queries,
+                                                                                   int K) const {
+    return searchBatch<std::vector<int>>(queries, num_threads,
+                                         [&](const unsigned char* q, std::vector<int>& candidates) {
+                                             return kNearestNeighbors(q, K, candidates);
+                                         });
 }
 
 
 // Overload 1: Doesn't take a radius, uses the class's private member R
-std::vector<int> Hypercube::rangeSearch(const std::vector<unsigned char>& q) {
+std::vector<int> Hypercube::rangeSearch(const unsigned char* q) const {
     return rangeSearch(q, R);
 }
 
 // Overload 2: Takes a radius and uses that
-std::vector<int> Hypercube::rangeSearch(const std::vector<unsigned char>& q, double radius) {
+std::vector<int> Hypercube::rangeSearch(const unsigned char* q, double radius) const {
+    std::vector<int> inRangeIndices;
+    rangeSearch(q, radius, [&](int index, double) { inRangeIndices.push_back(index); });
 
-    std::vector<int> candidateIndices = probe(q, probes); //
+    // Candidates are distinct, so sorting is all that is left
+    std::sort(inRangeIndices.begin(), inRangeIndices.end());
+    return inRangeIndices;
+}
+
+std::size_t Hypercube::rangeSearch(const unsigned char* q, double radius,
+                                   const std::function<void(int, double)>& visit, std::size_t max_results) const {
+    std::vector<int> candidateIndices;
+    probe(q, probes, candidateLimit(), candidateIndices);
     // print candiateIndices
     //std::cout << candidateIndices.size() << std::endl;
 
-    std::set<int> inRangeIndices; // Use a set to avoid duplicates
-    int checkedCandidates = 0;
-    //std::cout << "candidateIndices.size(): " << candidateIndices.size() << std::endl;
+    const std::uint64_t squared_radius = squaredRadius(radius);
+    const std::size_t limit = max_results > 0 ? max_results : std::numeric_limits<std::size_t>::max();
 
-    //std::cout << "Radius inside rangeSearch" << radius << std::endl;
-    for (const auto& index : candidateIndices) {
-        if (checkedCandidates >= M) {
-            break;
-        }
-        double distance = euclideanDistance(dataset[index], q);
-        //std::cout << "distance: " << distance << std::endl;
-        //std::cout << "radius: " << radius << std::endl;
-        if (distance <= radius) { // Use the provided radius
-            inRangeIndices.insert(index);
+    // At most M candidates are checked
+    selectCandidates(q, candidateIndices);
 
-        }
-        checkedCandidates++;
-    }
+    return scanWithinRadius(dataset, q, candidateIndices, squared_radius,
+                            [&](int row, double distance) { visit(originalId(row), distance); }, limit);
+}
 
-    // Convert the set to a vector for the final result
-    std::vector<int> result(inRangeIndices.begin(), inRangeIndices.end());
 
+void Hypercube::reduceDimensionality(const unsigned char* data_point, HashArithmetic with, float* out) const {
+    if (with == HashArithmetic::Quantized) {
+        projectPointQuantized(quantized_projection, data_point, out);
+    } else {
+        projectPoint(random_projection_matrix.data(), reduced_dimension, num_dimensions, data_point, out);
+    }
+}
+
+DatasetView Hypercube::getDataset() const {
+    return shared_dataset;
+}
 
-    return result;
+void Hypercube::setSearchParameters(int M_, int probes_) {
+    M = M_;
+    probes = probes_;
 }
 
+std::size_t Hypercube::memoryUsage() const {
+    std::size_t bytes = (bucket_offsets.capacity() + bucket_points.capacity() + original_ids.capacity()
+                         + rows_by_id.capacity()) * sizeof(int);
+    bytes += reordered_rows.size() * reordered_rows.stride();
+    bytes += (random_projection_matrix.capacity() + reduced_points.capacity() + function_vectors.capacity()
+              + function_offsets.capacity() + sketch_projections.capacity() + sketch_thresholds.capacity())
+             * sizeof(float);
+    bytes += sketches.capacity() * sizeof(std::uint64_t);
+    bytes += vertices.capacity() * sizeof(int) + probe_masks.capacity() * sizeof(int);
+    bytes += quantized_projection.weights.capacity() * sizeof(std::int16_t)
+             + quantized_projection.scales.capacity() * sizeof(float);
+    return bytes;
+}
 
-std::vector<float> Hypercube::reduceDimensionality(const std::vector<unsigned char>& data_point) {
-    //std::cout << "Entering reduceDimensionality function." << std::endl;
-    //std::cout << "data_point.size(): " << data_point.size() << std::endl;
-    std::vector<float> reduced_point(reduced_dimension, 0.0);
-    for (int i = 0; i < reduced_dimension; ++i) {
-        for (int j = 0; j < num_dimensions; ++j) {
-            reduced_point[i] += static_cast<float>(data_point[j]) * random_projection_matrix[i][j];
-            //std::cout << reduced_point[i] << std::endl;
+std::size_t Hypercube::hashDisagreements(DatasetView points) const {
+    std::size_t disagreements = 0;
+    std::vector<float> float_reduced(reduced_dimension);
+    std::vector<float> quantized_reduced(reduced_dimension);
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        reduceDimensionality(points.row(i), HashArithmetic::Float, float_reduced.data());
+        reduceDimensionality(points.row(i), HashArithmetic::Quantized, quantized_reduced.data());
+        if (idFromReduced(float_reduced.data()) != idFromReduced(quantized_reduced.data())) {
+            ++disagreements;
         }
     }
+    return disagreements;
+}
+
+const float* Hypercube::reducedPoint(int index) const {
+    return reducedRow(rows_by_id.empty() ? index : rows_by_id[index]);
+}
+
+const float* Hypercube::reducedRow(int row) const {
+    return reduced_points.data() + static_cast<std::size_t>(row) * reduced_dimension;
+}
+
+int Hypercube::reducedDimension() const {
+    return reduced_dimension;
+}
 
-    //std::cout << "Exiting reduceDimensionality function." << std::endl;
-    //std::cout << "reduced_point.size(): " << reduced_point.size() << std::endl;
-    return reduced_point;
+void Hypercube::setProbeOrder(ProbeOrder order) {
+    probe_order = order;
 }
 
-const std::vector<std::vector<unsigned char>>& Hypercube::getDataset() const {
-    return dataset;
+double Hypercube::bucketWidth() const {
+    return w;
 }
 
 int Hypercube::returnN() const {
@@ -2,58 +2,167 @@
 #define HYPERCUBE_H
 
 #include <vector>
+#include <cstdint>
 #include <random>
-#include <set>
+#include <functional>
+#include "dataset.h"
+#include "projection.h"
+
+// Order in which probe visits the vertices of the cube
+enum class ProbeOrder {
+    HammingBall,   // The query's vertex, then all vertices at Hamming distance 1, 2, ...
+    QueryDirected  // The query's vertex, then flips of the bits whose projections lie closest to a slot boundary
+};
 
+// Queries are const and may run concurrently from any number of threads; setSearchParameters,
+// setProbeOrder, rebuild, reorder and useSketches must not run at the same time as queries.
 class Hypercube {
 public:
-    explicit Hypercube(std::vector<std::vector<unsigned char>> dataset,
-              int k = 14,int M=6000,int probes=10, int N = 1, double R = 10000);
+    // bucket_width <= 0 draws w from [400, 500]. HashArithmetic::Quantized reduces dimensionality with int16
+    // weights on integer multiply-add; vertices match the float hash except at slot boundaries.
+    // num_threads <= 0 builds the cube and runs batches with one thread per core; the cube depends only on
+    // the seed, not on the thread count.
+    explicit Hypercube(DatasetView dataset,
+              int k = 14,int M=6000,int probes=10, int N = 1, double R = 10000,
+              unsigned int seed = std::random_device{}(), double bucket_width = 0,
+              HashArithmetic arithmetic = HashArithmetic::Float, int num_threads = 0);
     ~Hypercube();
 
 
-    std::vector<std::pair<int, double>> kNearestNeighbors(const std::vector<unsigned char>& q,int K);
-    std::vector<int> rangeSearch(const std::vector<unsigned char>& q);
-    std::vector<int> rangeSearch(const std::vector<unsigned char>& q, double radius);
+    std::vector<std::pair<int, double>> kNearestNeighbors(const unsigned char* q, int K) const;
+    std::vector<int> rangeSearch(const unsigned char* q) const;
+    std::vector<int> rangeSearch(const unsigned char* q, double radius) const;
+
+    // Streaming range search: calls visit(index, distance) for every candidate within radius, each point
+    // at most once, and stops after max_results hits (0 means no limit). Returns the number of hits.
+    std::size_t rangeSearch(const unsigned char* q, double radius, const std::function<void(int, double)>& visit,
+                            std::size_t max_results = 0) const;
+
+    // kNearestNeighbors of every query, spread over the index's threads. result[i] belongs to queries.row(i).
+    std::vector<std::vector<std::pair<int, double>>> kNearestNeighborsBatch(DatasetView queries, int K) const;
+
+    // The candidates a query measures, nearest vertex first (or as chosen by the sketches), as original indices
+    void candidates(const unsigned char* q, std::vector<int>& out) const;
+
+    // Function to get the dataset (the shared one, in its original order, even after reorder)
+    [[nodiscard]] DatasetView getDataset() const;
+
+    // Changes the query-time parameters without rebuilding the cube. A query visits vertices nearest first
+    // and stops after `probes` vertices or once M candidates are gathered, whichever comes first.
+    void setSearchParameters(int M, int probes);
+    void setProbeOrder(ProbeOrder order);
+
+    // Keeps a sketch of `bits` sign bits per point (a multiple of 64, e.g. 64 or 128): the signs of random
+    // projections of the mean-centered data. When probing gathers more than M candidates, the M whose
+    // sketches are nearest the query's in Hamming distance are measured instead of the first M found.
+    // 0 drops the sketches.
+    void useSketches(int bits);
+
+    // Rebuilds the cube with k hash functions from the stored reduced points, without projecting the dataset
+    // again. The cube is the one the constructor would have built with this k and the same seed.
+    void rebuild(int k);
+
+    // Scans a cube-owned copy of the rows sorted by vertex from now on, so that probing a vertex streams one
+    // contiguous block of rows. The shared dataset is left untouched; query results keep reporting its
+    // indices. The copy costs one more dataset's worth of memory. A later rebuild keeps the copy's row
+    // order; reorder again to restore locality.
+    void reorder();
+
+    // The d'-dimensional projection of point index (an original index, as reported by queries)
+    [[nodiscard]] const float* reducedPoint(int index) const;
+    [[nodiscard]] int reducedDimension() const;
 
-    // Function to get the dataset
-    const std::vector<std::vector<unsigned char>>& getDataset() const;
+    // Number of points mapped to a different vertex by float and quantized hashing
+    [[nodiscard]] std::size_t hashDisagreements(DatasetView points) const;
+
+    // Bytes held by the index itself (including the reordered copy of the rows), not counting the shared dataset
+    [[nodiscard]] std::size_t memoryUsage() const;
+    [[nodiscard]] double bucketWidth() const;
 
     [[nodiscard]] int returnN() const;
     [[nodiscard]] double returnR() const;
 
 private:
     // Member variables
-    std::vector<std::vector<unsigned char>> dataset;
+    DatasetView shared_dataset; // The shared dataset of points (not owned)
+    DatasetView dataset; // The rows queries scan: shared_dataset, or reordered_rows after reorder
     int k;
-    int num_dimensions = 784;
+    int num_dimensions; // Taken from the dataset
     int N;
     double R;
     double w;
     int reduced_dimension;
     int M;
-    int n=60000;
+    int n; // Number of points, taken from the dataset
     int probes;
-    std::vector<std::vector<float>> random_projection_matrix;
-    std::vector<std::vector<int>> hash_table;
-    std::vector<std::pair<std::vector<float>, float>> table_functions;
+    int num_threads; // Threads used to build the cube and to run batches
+    std::vector<float> random_projection_matrix; // Row-major, d' x num_dimensions
+    HashArithmetic arithmetic;
+    QuantizedMatrix quantized_projection; // int16 copy of random_projection_matrix
+    std::vector<float> reduced_points; // Every row of the dataset projected to d' dimensions, row-major n x d'
+    std::vector<int> vertices; // Vertex of every row
+    // Buckets in compressed (CSR) form: vertex v holds rows bucket_points[bucket_offsets[v], bucket_offsets[v + 1]),
+    // in increasing order
+    std::vector<int> bucket_offsets;
+    std::vector<int> bucket_points;
+    Dataset reordered_rows; // Cube-owned copy of the rows in vertex order; empty unless reordered
+    std::vector<int> original_ids; // Row -> original index; empty unless reordered
+    std::vector<int> rows_by_id; // Original index -> row; empty unless reordered
+    int sketch_words = 0; // 64-bit words per sketch; 0 without sketches
+    std::vector<float> sketch_projections; // Row-major (64 * sketch_words) x num_dimensions
+    std::vector<float> sketch_thresholds; // Projection of the dataset mean on each sketch row
+    std::vector<std::uint64_t> sketches; // sketch_words per row of the dataset
+    ProbeOrder probe_order = ProbeOrder::HammingBall;
+    std::vector<int> probe_masks; // All 2^k bit masks by increasing popcount, for Hamming-ball probing
+    std::vector<float> function_vectors; // v of the k hash functions, row-major k x d'
+    std::vector<float> function_offsets; // t of the k hash functions
     std::mt19937 generator;
+    std::mt19937 function_generator; // State of generator before the hash functions were drawn
 
     void buildIndex();
 
-    // Computes the ID value for a data point
-    int computeID(const std::vector<unsigned char>& data_point);
+    // Assigns every row to its vertex from reduced_points and fills the buckets and probe_masks
+    void assignVertices();
+
+    // Projection of a row
+    [[nodiscard]] const float* reducedRow(int row) const;
+
+    // Original index of a row of dataset; the identity unless the cube was reordered
+    [[nodiscard]] int originalId(int row) const;
+
+    // Sign bits of a point's sketch projections against the thresholds
+    void sketchFromProjections(const float* projections, std::uint64_t* sketch) const;
+
+    // Cuts candidates down to M: nearest sketches first when there are sketches, otherwise in probe order
+    void selectCandidates(const unsigned char* query_point, std::vector<int>& candidates) const;
+
+    // Vertex of a point already reduced to d' dimensions
+    int idFromReduced(const float* reduced_data_point) const;
+
+    // Positions (dot + t) / w of a reduced point on the k functions, in slot widths; the fractional
+    // part tells how close each bit is to flipping
+    void slotPositions(const float* reduced_data_point, double* positions) const;
 
     // Defines the function to map hi values to {0, 1}
-    int fi(int hi_value);
+    static int fi(int hi_value);
+
+    // Fills candidates by probing the vertices of the hypercube for the given query point in the current
+    // probe order, until maxProbes vertices are visited or candidate_limit candidates are gathered.
+    // Scratch space is per thread.
+    void probe(const unsigned char* query_point, int maxProbes, std::size_t candidate_limit,
+               std::vector<int>& candidates) const;
+
+    // Candidates to gather per query: M, or the whole vertex budget when sketches choose the M to measure
+    [[nodiscard]] std::size_t candidateLimit() const;
 
-    // Returns candidates by probing the hypercube for the given query point
-    std::vector<int> probe(const std::vector<unsigned char>& query_point, int maxHammingDistance);
-    // Creates hash functions for the hypercube
-    std::vector<std::pair<std::vector<float>, float>> createHashFunctions(int k, int dim);
+    // kNearestNeighbors with the caller's candidate buffer
+    std::vector<std::pair<int, double>> kNearestNeighbors(const unsigned char* q, int K,
+                                                          std::vector<int>& candidates) const;
+    // Draws the k hash functions over d' dimensions from function_generator
+    void createHashFunctions();
 
-    // Reduces the dimensionality of the data point using the random projection matrix
-    std::vector<float> reduceDimensionality(const std::vector<unsigned char>& data_point);
+    // Reduces the dimensionality of the data point using the random projection matrix; out holds d' floats
+    void reduceDimensionality(const unsigned char* data_point, HashArithmetic with, float* out) const;
 
 
 
@@ -0,0 +1,136 @@
+#include "HypercubeEnsemble.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "global_functions.h"
+
+HypercubeEnsemble::HypercubeEnsemble(DatasetView dataset, int cubes, int k, int M, int probes, int N, double R,
+                                     unsigned int seed, double bucket_width, HashArithmetic arithmetic,
+                                     int num_threads)
+        : dataset(dataset), M(M), N(N), R(R), num_threads(num_threads) {
+    if (cubes < 1) {
+        throw std::invalid_argument("An ensemble needs at least one cube.");
+    }
+
+    std::mt19937 generator(seed);
+    std::vector<unsigned int> seeds(cubes);
+    for (unsigned int& cube_seed : seeds) {
+        cube_seed = generator();
+    }
+
+    // Cubes are built side by side, one thread each; every cube depends only on its own seed
+    this->cubes.resize(cubes);
+    parallelFor(static_cast<std::size_t>(cubes), 1, num_threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t c = begin; c < end; ++c) {
+            this->cubes[c] = std::make_unique<Hypercube>(dataset, k, M, probes, N, R, seeds[c], bucket_width,
+                                                         arithmetic, 1);
+        }
+    });
+}
+
+void HypercubeEnsemble::candidates(const unsigned char* q, std::vector<std::vector<int>>& per_cube,
+                                   std::vector<int>& out) const {
+    per_cube.resize(cubes.size());
+    std::size_t longest = 0;
+    for (std::size_t c = 0; c < cubes.size(); ++c) {
+        cubes[c]->candidates(q, per_cube[c]);
+        longest = std::max(longest, per_cube[c].size());
+    }
+
+    thread_local VisitedSet visited;
+    visited.clear(dataset.size());
+    out.clear();
+    const std::size_t limit = static_cast<std::size_t>(std::max(M, 0));
+    for (std::size_t rank = 0; rank < longest && out.size() < limit; ++rank) {
+        for (std::size_t c = 0; c < per_cube.size() && out.size() < limit; ++c) {
+            if (rank < per_cube[c].size() && visited.insert(per_cube[c][rank])) {
+                out.push_back(per_cube[c][rank]);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<int, double>> HypercubeEnsemble::kNearestNeighbors(const unsigned char* q, int K) const {
+    std::vector<std::vector<int>> per_cube;
+    std::vector<int> merged;
+    return kNearestNeighbors(q, K, per_cube, merged);
+}
+
+std::vector<std::pair<int, double>> HypercubeEnsemble::kNearestNeighbors(const unsigned char* q, int K,
+                                                                         std::vector<std::vector<int>>& per_cube,
+                                                                         std::vector<int>& merged) const {
+    candidates(q, per_cube, merged);
+    TopKHeap nearest_neighbors(K);
+    scanCandidates(dataset, q, merged, nearest_neighbors);
+    return nearest_neighbors.sortedResults();
+}
+
+std::vector<std::vector<std::pair<int, double>>> HypercubeEnsemble::kNearestNeighborsBatch(DatasetView queries,
+                                                                                           int K) const {
+    // Scratch: the cubes' own candidate lists and the merged list
+    using Scratch = std::pair<std::vector<std::vector<int>>, std::vector<int>>;
+    return searchBatch<Scratch>(queries, num_threads, [&](const unsigned char* q, Scratch& scratch) {
+        return kNearestNeighbors(q, K, scratch.first, scratch.second);
+    });
+}
+
+// Overload 1: Doesn't take a radius, uses the class's private member R
+std::vector<int> HypercubeEnsemble::rangeSearch(const unsigned char* q) const {
+    return rangeSearch(q, R);
+}
+
+// Overload 2: Takes a radius and uses that
+std::vector<int> HypercubeEnsemble::rangeSearch(const unsigned char* q, double radius) const {
+    std::vector<int> inRangeIndices;
+    rangeSearch(q, radius, [&](int index, double) { inRangeIndices.push_back(index); });
+    std::sort(inRangeIndices.begin(), inRangeIndices.end());
+    return inRangeIndices;
+}
+
+std::size_t HypercubeEnsemble::rangeSearch(const unsigned char* q, double radius,
+                                           const std::function<void(int, double)>& visit,
+                                           std::size_t max_results) const {
+    std::vector<std::vector<int>> per_cube;
+    std::vector<int> candidateIndices;
+    candidates(q, per_cube, candidateIndices);
+
+    const std::size_t limit = max_results > 0 ? max_results : std::numeric_limits<std::size_t>::max();
+    return scanWithinRadius(dataset, q, candidateIndices, squaredRadius(radius), visit, limit);
+}
+
+void HypercubeEnsemble::setSearchParameters(int M_, int probes) {
+    M = M_;
+    for (auto& cube : cubes) {
+        cube->setSearchParameters(M_, probes);
+    }
+}
+
+void HypercubeEnsemble::setProbeOrder(ProbeOrder order) {
+    for (auto& cube : cubes) {
+        cube->setProbeOrder(order);
+    }
+}
+
+DatasetView HypercubeEnsemble::getDataset() const {
+    return dataset;
+}
+
+int HypercubeEnsemble::cubeCount() const {
+    return static_cast<int>(cubes.size());
+}
+
+std::size_t HypercubeEnsemble::memoryUsage() const {
+    std::size_t bytes = 0;
+    for (const auto& cube : cubes) {
+        bytes += cube->memoryUsage();
+    }
+    return bytes;
+}
+
+int HypercubeEnsemble::returnN() const {
+    return N;
+}
+
+double HypercubeEnsemble::returnR() const {
+    return R;
+}
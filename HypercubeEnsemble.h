@@ -0,0 +1,68 @@
+#ifndef HYPERCUBE_ENSEMBLE_H
+#define HYPERCUBE_ENSEMBLE_H
+
+#include <memory>
+#include <vector>
+#include <random>
+#include <functional>
+#include "dataset.h"
+#include "Hypercube.h"
+
+// Several independently seeded hypercubes over one shared dataset. Each cube is probed with a small
+// budget; their candidates are merged through one visited set, so a point found by several cubes is
+// measured once, and at most M distinct candidates are measured in all.
+// Like Hypercube, queries are const and may run concurrently; the setters must not.
+class HypercubeEnsemble {
+public:
+    // k, probes, bucket_width and arithmetic apply to every cube; M is the budget of the whole ensemble.
+    // The cubes' seeds are drawn from seed. num_threads <= 0 builds the cubes and runs batches with one
+    // thread per core.
+    explicit HypercubeEnsemble(DatasetView dataset, int cubes = 4,
+                               int k = 14, int M = 6000, int probes = 3, int N = 1, double R = 10000,
+                               unsigned int seed = std::random_device{}(), double bucket_width = 0,
+                               HashArithmetic arithmetic = HashArithmetic::Float, int num_threads = 0);
+
+    std::vector<std::pair<int, double>> kNearestNeighbors(const unsigned char* q, int K) const;
+    std::vector<int> rangeSearch(const unsigned char* q) const;
+    std::vector<int> rangeSearch(const unsigned char* q, double radius) const;
+
+    // Streaming range search, as in Hypercube
+    std::size_t rangeSearch(const unsigned char* q, double radius, const std::function<void(int, double)>& visit,
+                            std::size_t max_results = 0) const;
+
+    // kNearestNeighbors of every query, spread over the ensemble's threads. result[i] belongs to queries.row(i).
+    std::vector<std::vector<std::pair<int, double>>> kNearestNeighborsBatch(DatasetView queries, int K) const;
+
+    // M distinct candidates in all, `probes` vertices per cube
+    void setSearchParameters(int M, int probes);
+    void setProbeOrder(ProbeOrder order);
+
+    [[nodiscard]] DatasetView getDataset() const;
+    [[nodiscard]] int cubeCount() const;
+
+    // Bytes held by all cubes, not counting the shared dataset
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+    [[nodiscard]] int returnN() const;
+    [[nodiscard]] double returnR() const;
+
+private:
+    DatasetView dataset; // The shared dataset of points (not owned)
+    int M;
+    int N;
+    double R;
+    int num_threads; // Threads used to build the cubes and to run batches
+    std::vector<std::unique_ptr<Hypercube>> cubes;
+
+    // Candidates of all cubes, merged rank by rank (every cube's first candidate, then every cube's
+    // second, ...) so the vertices nearest the query in each cube come first; each point appears once
+    // and at most M are kept. per_cube is scratch for the cubes' own lists.
+    void candidates(const unsigned char* q, std::vector<std::vector<int>>& per_cube, std::vector<int>& out) const;
+
+    // kNearestNeighbors with the caller's scratch buffers
+    std::vector<std::pair<int, double>> kNearestNeighbors(const unsigned char* q, int K,
+                                                          std::vector<std::vector<int>>& per_cube,
+                                                          std::vector<int>& merged) const;
+};
+
+#endif // HYPERCUBE_ENSEMBLE_H
@@ -1,38 +1,41 @@
 #include "MRNGGraph.h"
 #include <algorithm>
+#include <cmath>
 
 // Node constructor
-MRNGNode::MRNGNode(const std::vector<unsigned char>& data) : data(data) {}
+MRNGNode::MRNGNode(const unsigned char* data) : data(data) {}
 
 // MRNG Graph constructor
-MRNGGraph::MRNGGraph(const std::vector<std::vector<unsigned char>>& dataset, int l, int N) {
+MRNGGraph::MRNGGraph(DatasetView dataset, int l, int N) : points(dataset) {
     // Reserve memory for nodes to improve efficiency
     nodes.reserve(dataset.size());
 
     // Construct the graph from the dataset
-    for (const auto& dataPoint : dataset) {
-        nodes.emplace_back(dataPoint); // Adding each data point as a node
+    for (std::size_t i = 0; i < dataset.size(); ++i) {
+        nodes.emplace_back(dataset.row(i)); // Adding each data point as a node
     }
 
+    const std::size_t dim = dataset.dimension();
+    std::vector<int> allIndices(nodes.size());
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        allIndices[i] = static_cast<int>(i);
+    }
+    std::vector<std::uint64_t> distances;
+
     // MRNG construction
     for (auto& p : nodes) {
-        std::vector<MRNGNode*> Rp; // Candidate set for potential neighbors
-        Rp.reserve(nodes.size() - 1);
-
-        // Exclude the current node when considering potential neighbors
-        for (auto& r : nodes) {
-            if (&p != &r) {
-                Rp.push_back(&r);
+        // Distances from p to every node in one batch; squared, since the comparisons below only need their order
+        distancesToMany(points, p.data, allIndices, distances);
+
+        // Candidate set for potential neighbors: every node except p, paired with its distance to p
+        std::vector<std::pair<MRNGNode*, std::uint64_t>> distRp;
+        distRp.reserve(nodes.size() - 1);
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            if (&nodes[i] != &p) {
+                distRp.emplace_back(&nodes[i], distances[i]);
             }
         }
 
-        // Calculate distances and sort Rp according to distance to p
-        std::vector<std::pair<MRNGNode*, double>> distRp; // Pair of node and its distance to p
-        for (auto* node : Rp) {
-            double dist = euclideanDistance(p.data, node->data); // Euclidean distance calculation
-            distRp.emplace_back(node, dist);
-        }
-
         // Sort based on distance - closer nodes first
         std::sort(distRp.begin(), distRp.end(), [](const auto& a, const auto& b) {
             return a.second < b.second;
@@ -56,8 +59,10 @@ MRNGGraph::MRNGGraph(const std::vector<std::vector<unsigned char>>& dataset, int
             // Ensuring Monotonic Path Validation
             bool isLongestEdge = true;
             for (auto& t : Lp) {
-                double dist_pt = euclideanDistance(p.data, t->data);
-                double dist_rt = euclideanDistance(r->data, t->data);
+                // Only "is it at least dist_pr" matters, so both evaluations may stop once they reach it
+                std::uint64_t bound = dist_pr == 0 ? 0 : dist_pr - 1;
+                std::uint64_t dist_pt = squaredEuclideanDistance(p.data, t->data, dim, bound);
+                std::uint64_t dist_rt = squaredEuclideanDistance(r->data, t->data, dim, bound);
 
                 // Check if the potential edge is the longest in the triangle p-r-t
                 if (dist_pr <= dist_pt || dist_pr <= dist_rt) {
@@ -77,38 +82,43 @@ MRNGGraph::MRNGGraph(const std::vector<std::vector<unsigned char>>& dataset, int
 }
 
 // Search function on the MRNG
-std::vector<std::pair<int, double>> MRNGGraph::searchOnGraph(const std::vector<unsigned char>& query, int startNodeIndex, int k, int l) {
-    std::vector<std::pair<int, double>> potentialNeighbors; // To store potential neighbors
-    std::vector<MRNGNode*> candidatePool; // Pool of candidate nodes for the search
+std::vector<std::pair<int, double>> MRNGGraph::searchOnGraph(const unsigned char* query, int startNodeIndex, int k, int l) {
+    std::vector<std::pair<int, std::uint64_t>> potentialNeighbors; // To store potential neighbors (squared distances)
+    // Pool of candidate nodes for the search, each with its squared distance to the query
+    std::vector<std::pair<MRNGNode*, std::uint64_t>> candidatePool;
+    std::vector<int> neighborIndices;
+    std::vector<std::uint64_t> distances;
     const auto& nodes_ = this->getNodes(); // Get all nodes in the graph
 
     // Start from the specified node
-    candidatePool.push_back(const_cast<MRNGNode*>(&nodes_[startNodeIndex]));
+    candidatePool.emplace_back(const_cast<MRNGNode*>(&nodes_[startNodeIndex]), 0);
 
     // Search loop
     while (!candidatePool.empty() && candidatePool.size() < l) {
-        auto currentNode = candidatePool.front();
+        MRNGNode* currentNode = candidatePool.front().first;
         candidatePool.erase(candidatePool.begin());
 
-        // Explore neighbors of the current node
-        for (auto& neighbor : currentNode->neighbors) {
-            double distance = euclideanDistance(query, neighbor->data); // Distance to query
-            int nodeIndex = std::distance(nodes_.begin(), std::find_if(nodes_.begin(), nodes_.end(),
-                                                                       [neighbor](const MRNGNode& node) {
-                                                                           return &node == neighbor;
-                                                                       }));
-            potentialNeighbors.emplace_back(nodeIndex, distance);
+        // Measure all neighbors of the current node in one batch
+        neighborIndices.clear();
+        for (MRNGNode* neighbor : currentNode->neighbors) {
+            neighborIndices.push_back(static_cast<int>(neighbor - nodes_.data())); // Nodes are stored contiguously
+        }
+        distancesToMany(points, query, neighborIndices, distances);
+
+        for (std::size_t i = 0; i < neighborIndices.size(); ++i) {
+            MRNGNode* neighbor = currentNode->neighbors[i];
+            potentialNeighbors.emplace_back(neighborIndices[i], distances[i]);
 
             // Add neighbor to candidate pool if not already present
-            if (std::find(candidatePool.begin(), candidatePool.end(), neighbor) == candidatePool.end()) {
-                candidatePool.push_back(neighbor);
+            if (std::none_of(candidatePool.begin(), candidatePool.end(),
+                             [&](const auto& candidate) { return candidate.first == neighbor; })) {
+                candidatePool.emplace_back(neighbor, distances[i]);
             }
         }
 
-        // Sort and limit candidate pool size to l
-        std::sort(candidatePool.begin(), candidatePool.end(), [&](MRNGNode* a, MRNGNode* b) {
-            return euclideanDistance(query, a->data) < euclideanDistance(query, b->data);
-        });
+        // Sort by the cached distances and limit candidate pool size to l
+        std::sort(candidatePool.begin(), candidatePool.end(),
+                  [](const auto& a, const auto& b) { return a.second < b.second; });
         if (candidatePool.size() > l) {
             candidatePool.resize(l);
         }
@@ -116,13 +126,13 @@ std::vector<std::pair<int, double>> MRNGGraph::searchOnGraph(const std::vector<u
 
     // Sort potential neighbors based on their distance to the query point
     std::sort(potentialNeighbors.begin(), potentialNeighbors.end(),
-              [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+              [](const std::pair<int, std::uint64_t>& a, const std::pair<int, std::uint64_t>& b) {
                   return a.second < b.second;
               });
 
     // Remove duplicates from the potential neighbors
     auto last = std::unique(potentialNeighbors.begin(), potentialNeighbors.end(),
-                            [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+                            [](const std::pair<int, std::uint64_t>& a, const std::pair<int, std::uint64_t>& b) {
                                 return a.first == b.first;
                             });
     potentialNeighbors.erase(last, potentialNeighbors.end());
@@ -132,5 +142,11 @@ std::vector<std::pair<int, double>> MRNGGraph::searchOnGraph(const std::vector<u
         potentialNeighbors.resize(k);
     }
 
-    return potentialNeighbors;
+    // Only the reported neighbors are converted back to true L2
+    std::vector<std::pair<int, double>> nearestNeighbors;
+    nearestNeighbors.reserve(potentialNeighbors.size());
+    for (const auto& [index, distance] : potentialNeighbors) {
+        nearestNeighbors.emplace_back(index, std::sqrt(static_cast<double>(distance)));
+    }
+    return nearestNeighbors;
 }
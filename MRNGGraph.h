@@ -3,21 +3,23 @@
 
 #include <vector>
 #include "global_functions.h" // Include the header for euclideanDistance
+#include "dataset.h"
 
 class MRNGNode {
 public:
-    std::vector<unsigned char> data;
+    const unsigned char* data; // Row of the shared dataset (not owned)
     std::vector<MRNGNode*> neighbors;
-    explicit MRNGNode(const std::vector<unsigned char>& data);
+    explicit MRNGNode(const unsigned char* data);
 };
 
 class MRNGGraph {
 private:
     std::vector<MRNGNode> nodes;
+    DatasetView points;
 
 public:
-    explicit MRNGGraph(const std::vector<std::vector<unsigned char>>& dataset, int l = 20, int N = 1);
-    std::vector<std::pair<int, double>> searchOnGraph(const std::vector<unsigned char>& query, int startNodeIndex, int k, int l);
+    explicit MRNGGraph(DatasetView dataset, int l = 20, int N = 1);
+    std::vector<std::pair<int, double>> searchOnGraph(const unsigned char* query, int startNodeIndex, int k, int l);
     [[nodiscard]] const std::vector<MRNGNode>& getNodes() const { return nodes; }
 
 };
@@ -0,0 +1,14 @@
+#ifndef PROJECT_K23_SEC_CPU_FEATURES_H
+#define PROJECT_K23_SEC_CPU_FEATURES_H
+
+//
+// K23_X86 is defined on x86 builds, where the SIMD intrinsics, __attribute__((target)) variants and
+// __builtin_cpu_supports dispatch are available. Every other build uses the portable scalar code.
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define K23_X86 1
+#endif
+
+#endif //PROJECT_K23_SEC_CPU_FEATURES_H
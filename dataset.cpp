@@ -0,0 +1,65 @@
+#include "dataset.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+DatasetView::DatasetView(const unsigned char* data, std::size_t rows, std::size_t dimension, std::size_t stride)
+        : data(data), rows(rows), dim(dimension), row_stride(stride) {
+    if (stride < dimension) {
+        throw std::invalid_argument("Row stride must be at least the dimension.");
+    }
+}
+
+DatasetView DatasetView::head(std::size_t count) const {
+    if (count > rows) {
+        throw std::out_of_range("View has fewer rows than requested.");
+    }
+    return {data, count, dim, row_stride};
+}
+
+std::vector<unsigned char> DatasetView::rowVector(std::size_t index) const {
+    return {row(index), row(index) + dim};
+}
+
+Dataset::Dataset(std::size_t rows, std::size_t dimension)
+        : rows(rows), dim(dimension),
+          row_stride((dimension + alignment - 1) / alignment * alignment) {
+    std::size_t bytes = rows * row_stride;
+    if (bytes == 0) {
+        return;
+    }
+    // The size is a multiple of the alignment, as std::aligned_alloc requires
+    storage.reset(static_cast<unsigned char*>(std::aligned_alloc(alignment, bytes)));
+    if (!storage) {
+        throw std::bad_alloc();
+    }
+    base = storage.get();
+    // Rows are padded so each one starts on a 64-byte boundary. No kernel reads the padding; it is zeroed
+    // so that copies of whole strides (as when a store grows) never read uninitialized bytes.
+    std::memset(storage.get(), 0, bytes);
+}
+
+Dataset Dataset::fromRows(const std::vector<std::vector<unsigned char>>& rows) {
+    Dataset dataset(rows.size(), rows.empty() ? 0 : rows.front().size());
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i].size() != dataset.dimension()) {
+            throw std::invalid_argument("All rows must have the same dimension.");
+        }
+        std::memcpy(dataset.mutableRow(i), rows[i].data(), rows[i].size());
+    }
+    return dataset;
+}
+
+Dataset Dataset::wrap(const unsigned char* data, std::size_t rows, std::size_t dimension, std::size_t stride,
+                      std::shared_ptr<const void> owner) {
+    if (stride < dimension) {
+        throw std::invalid_argument("Row stride must be at least the dimension.");
+    }
+    Dataset dataset;
+    dataset.rows = rows;
+    dataset.dim = dimension;
+    dataset.row_stride = stride;
+    dataset.base = data;
+    dataset.owner = std::move(owner);
+    return dataset;
+}
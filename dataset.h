@@ -0,0 +1,84 @@
+#ifndef PROJECT_K23_SEC_DATASET_H
+#define PROJECT_K23_SEC_DATASET_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Non-owning, cheap-to-copy view of row-major uint8 vectors.
+// Consecutive rows are `stride` bytes apart; only the first `dimension` bytes of a row are data.
+class DatasetView {
+public:
+    DatasetView() = default;
+    DatasetView(const unsigned char* data, std::size_t rows, std::size_t dimension, std::size_t stride);
+
+    [[nodiscard]] const unsigned char* row(std::size_t index) const { return data + index * row_stride; }
+    [[nodiscard]] std::size_t size() const { return rows; }
+    [[nodiscard]] std::size_t dimension() const { return dim; }
+    [[nodiscard]] std::size_t stride() const { return row_stride; }
+    [[nodiscard]] bool empty() const { return rows == 0; }
+
+    // View of the first `count` rows
+    [[nodiscard]] DatasetView head(std::size_t count) const;
+
+    // Copy of a single row, for code that still works on std::vector
+    [[nodiscard]] std::vector<unsigned char> rowVector(std::size_t index) const;
+
+private:
+    const unsigned char* data = nullptr;
+    std::size_t rows = 0;
+    std::size_t dim = 0;
+    std::size_t row_stride = 0;
+};
+
+// Owning dataset store: one contiguous, 64-byte aligned block in which every row is zero-padded
+// to a whole number of cache lines. Indexes reference it through DatasetView instead of copying it.
+// A Dataset can also wrap rows that live in external memory (e.g. a memory-mapped file); it then keeps
+// that memory alive through `owner` and its rows are read-only.
+class Dataset {
+public:
+    static constexpr std::size_t alignment = 64;
+
+    Dataset() = default;
+    Dataset(std::size_t rows, std::size_t dimension);
+
+    // Copies vector-of-vectors data into the flat layout
+    static Dataset fromRows(const std::vector<std::vector<unsigned char>>& rows);
+
+    // Wraps external rows without copying them; `owner` is released when the Dataset goes away
+    static Dataset wrap(const unsigned char* data, std::size_t rows, std::size_t dimension, std::size_t stride,
+                        std::shared_ptr<const void> owner);
+
+    [[nodiscard]] const unsigned char* row(std::size_t index) const { return base + index * row_stride; }
+    // Only available on datasets that own their storage; wrapped (e.g. memory-mapped) rows are read-only
+    [[nodiscard]] unsigned char* mutableRow(std::size_t index) {
+        if (!storage) {
+            throw std::logic_error("Dataset rows are read-only: the dataset wraps external memory.");
+        }
+        return storage.get() + index * row_stride;
+    }
+    [[nodiscard]] bool ownsStorage() const { return storage != nullptr || rows == 0; }
+    [[nodiscard]] std::size_t size() const { return rows; }
+    [[nodiscard]] std::size_t dimension() const { return dim; }
+    [[nodiscard]] std::size_t stride() const { return row_stride; }
+    [[nodiscard]] bool empty() const { return rows == 0; }
+
+    [[nodiscard]] DatasetView view() const { return {base, rows, dim, row_stride}; }
+    operator DatasetView() const { return view(); } // NOLINT: a Dataset can be passed wherever a view is expected
+
+private:
+    struct FreeDeleter {
+        void operator()(unsigned char* pointer) const { std::free(pointer); }
+    };
+
+    std::unique_ptr<unsigned char[], FreeDeleter> storage;
+    std::shared_ptr<const void> owner;
+    const unsigned char* base = nullptr;
+    std::size_t rows = 0;
+    std::size_t dim = 0;
+    std::size_t row_stride = 0;
+};
+
+#endif //PROJECT_K23_SEC_DATASET_H
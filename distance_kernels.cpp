@@ -0,0 +1,368 @@
+#include "distance_kernels.h"
+#include <algorithm>
+#include <limits>
+#include "cpu_features.h"
+
+// The SIMD kernels keep per-lane 32-bit partial sums. Every lane gains at most 2 * 255^2 per step,
+// so the lanes are flushed into a 64-bit total once per block to rule out overflow on long vectors.
+static constexpr std::size_t kFlushBlock = 4096;
+
+// Number of dimensions between two checks of the bound in squaredL2Bounded
+static constexpr std::size_t kAbandonChunk = 128;
+
+std::uint64_t squaredL2Scalar(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    std::uint64_t distance = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        int diff = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+        distance += static_cast<std::uint64_t>(diff * diff);
+    }
+    return distance;
+}
+
+void squaredL2x4Scalar(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    for (int r = 0; r < 4; ++r) {
+        out[r] = squaredL2Scalar(query, rows[r], n);
+    }
+}
+
+void dotU8x4Scalar(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    for (int r = 0; r < 4; ++r) {
+        std::uint64_t dot = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            dot += static_cast<std::uint32_t>(query[i]) * rows[r][i];
+        }
+        out[r] = dot;
+    }
+}
+
+#ifdef K23_X86
+
+__attribute__((target("sse4.1")))
+std::uint64_t squaredL2SSE41(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    std::uint64_t distance = 0;
+    std::size_t i = 0;
+    while (i + 16 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= block_end; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i lo = _mm_sub_epi16(_mm_cvtepu8_epi16(va), _mm_cvtepu8_epi16(vb));
+            __m128i hi = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(va, 8)),
+                                       _mm_cvtepu8_epi16(_mm_srli_si128(vb, 8)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+        }
+        alignas(16) std::uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        distance += static_cast<std::uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    return distance + squaredL2Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+std::uint64_t squaredL2AVX2(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    std::uint64_t distance = 0;
+    std::size_t i = 0;
+    while (i + 32 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 32 <= block_end; i += 32) {
+            __m128i a_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i a_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16));
+            __m128i b_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i b_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16));
+            __m256i lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a_lo), _mm256_cvtepu8_epi16(b_lo));
+            __m256i hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a_hi), _mm256_cvtepu8_epi16(b_hi));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(lo, lo));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(hi, hi));
+        }
+        alignas(32) std::uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (std::uint32_t lane : lanes) {
+            distance += lane;
+        }
+    }
+    return distance + squaredL2Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+std::uint64_t squaredL2AVX512BW(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    std::uint64_t distance = 0;
+    std::size_t i = 0;
+    while (i + 64 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m512i acc = _mm512_setzero_si512();
+        for (; i + 64 <= block_end; i += 64) {
+            __m256i a_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i a_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32));
+            __m256i b_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i b_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32));
+            __m512i lo = _mm512_sub_epi16(_mm512_cvtepu8_epi16(a_lo), _mm512_cvtepu8_epi16(b_lo));
+            __m512i hi = _mm512_sub_epi16(_mm512_cvtepu8_epi16(a_hi), _mm512_cvtepu8_epi16(b_hi));
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(lo, lo));
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(hi, hi));
+        }
+        distance += static_cast<std::uint32_t>(_mm512_reduce_add_epi32(acc));
+    }
+    return distance + squaredL2Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+std::uint64_t squaredL2AVX512VNNI(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    std::uint64_t distance = 0;
+    std::size_t i = 0;
+    while (i + 64 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m512i acc = _mm512_setzero_si512();
+        for (; i + 64 <= block_end; i += 64) {
+            __m256i a_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i a_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32));
+            __m256i b_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i b_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32));
+            __m512i lo = _mm512_sub_epi16(_mm512_cvtepu8_epi16(a_lo), _mm512_cvtepu8_epi16(b_lo));
+            __m512i hi = _mm512_sub_epi16(_mm512_cvtepu8_epi16(a_hi), _mm512_cvtepu8_epi16(b_hi));
+            // vpdpwssd fuses the multiply-add and the accumulation into one instruction
+            acc = _mm512_dpwssd_epi32(acc, lo, lo);
+            acc = _mm512_dpwssd_epi32(acc, hi, hi);
+        }
+        distance += static_cast<std::uint32_t>(_mm512_reduce_add_epi32(acc));
+    }
+    return distance + squaredL2Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void squaredL2x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    std::uint64_t totals[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    while (i + 16 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+        for (; i + 16 <= block_end; i += 16) {
+            __m256i q = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(query + i)));
+            for (int r = 0; r < 4; ++r) {
+                __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + i)));
+                __m256i diff = _mm256_sub_epi16(x, q);
+                acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(diff, diff));
+            }
+        }
+        for (int r = 0; r < 4; ++r) {
+            alignas(32) std::uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc[r]);
+            for (std::uint32_t lane : lanes) {
+                totals[r] += lane;
+            }
+        }
+    }
+    for (int r = 0; r < 4; ++r) {
+        out[r] = totals[r] + squaredL2Scalar(query + i, rows[r] + i, n - i);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void squaredL2x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    std::uint64_t totals[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    while (i + 32 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512()};
+        for (; i + 32 <= block_end; i += 32) {
+            __m512i q = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + i)));
+            for (int r = 0; r < 4; ++r) {
+                __m512i x = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + i)));
+                __m512i diff = _mm512_sub_epi16(x, q);
+                acc[r] = _mm512_add_epi32(acc[r], _mm512_madd_epi16(diff, diff));
+            }
+        }
+        for (int r = 0; r < 4; ++r) {
+            totals[r] += static_cast<std::uint32_t>(_mm512_reduce_add_epi32(acc[r]));
+        }
+    }
+    for (int r = 0; r < 4; ++r) {
+        out[r] = totals[r] + squaredL2Scalar(query + i, rows[r] + i, n - i);
+    }
+}
+
+// Products of two uint8 values fit in int16 lanes only after widening; vpmaddwd then adds pairs into int32
+__attribute__((target("avx2")))
+void dotU8x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    std::uint64_t totals[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    while (i + 16 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+        for (; i + 16 <= block_end; i += 16) {
+            __m256i q = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(query + i)));
+            for (int r = 0; r < 4; ++r) {
+                __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + i)));
+                acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(x, q));
+            }
+        }
+        for (int r = 0; r < 4; ++r) {
+            alignas(32) std::uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc[r]);
+            for (std::uint32_t lane : lanes) {
+                totals[r] += lane;
+            }
+        }
+    }
+    const unsigned char* tails[4] = {rows[0] + i, rows[1] + i, rows[2] + i, rows[3] + i};
+    dotU8x4Scalar(query + i, tails, n - i, out);
+    for (int r = 0; r < 4; ++r) {
+        out[r] += totals[r];
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void dotU8x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    std::uint64_t totals[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    while (i + 32 <= n) {
+        std::size_t block_end = std::min(n, i + kFlushBlock);
+        __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512()};
+        for (; i + 32 <= block_end; i += 32) {
+            __m512i q = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + i)));
+            for (int r = 0; r < 4; ++r) {
+                __m512i x = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + i)));
+                acc[r] = _mm512_add_epi32(acc[r], _mm512_madd_epi16(x, q));
+            }
+        }
+        for (int r = 0; r < 4; ++r) {
+            totals[r] += static_cast<std::uint32_t>(_mm512_reduce_add_epi32(acc[r]));
+        }
+    }
+    const unsigned char* tails[4] = {rows[0] + i, rows[1] + i, rows[2] + i, rows[3] + i};
+    dotU8x4Scalar(query + i, tails, n - i, out);
+    for (int r = 0; r < 4; ++r) {
+        out[r] += totals[r];
+    }
+}
+
+#else
+
+// Non-x86 builds only have the scalar kernel
+std::uint64_t squaredL2SSE41(const unsigned char* a, const unsigned char* b, std::size_t n) { return squaredL2Scalar(a, b, n); }
+std::uint64_t squaredL2AVX2(const unsigned char* a, const unsigned char* b, std::size_t n) { return squaredL2Scalar(a, b, n); }
+std::uint64_t squaredL2AVX512BW(const unsigned char* a, const unsigned char* b, std::size_t n) { return squaredL2Scalar(a, b, n); }
+std::uint64_t squaredL2AVX512VNNI(const unsigned char* a, const unsigned char* b, std::size_t n) { return squaredL2Scalar(a, b, n); }
+void squaredL2x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) { squaredL2x4Scalar(query, rows, n, out); }
+void squaredL2x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) { squaredL2x4Scalar(query, rows, n, out); }
+void dotU8x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) { dotU8x4Scalar(query, rows, n, out); }
+void dotU8x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) { dotU8x4Scalar(query, rows, n, out); }
+
+#endif
+
+std::vector<std::pair<const char*, SquaredL2Kernel>> availableSquaredL2Kernels() {
+    std::vector<std::pair<const char*, SquaredL2Kernel>> kernels;
+    kernels.emplace_back("scalar", &squaredL2Scalar);
+#ifdef K23_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels.emplace_back("sse4.1", &squaredL2SSE41);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.emplace_back("avx2", &squaredL2AVX2);
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels.emplace_back("avx512bw", &squaredL2AVX512BW);
+        if (__builtin_cpu_supports("avx512vnni")) {
+            kernels.emplace_back("avx512vnni", &squaredL2AVX512VNNI);
+        }
+    }
+#endif
+    return kernels;
+}
+
+std::vector<std::pair<const char*, SquaredL2x4Kernel>> availableSquaredL2x4Kernels() {
+    std::vector<std::pair<const char*, SquaredL2x4Kernel>> kernels;
+    kernels.emplace_back("scalar", &squaredL2x4Scalar);
+#ifdef K23_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.emplace_back("avx2", &squaredL2x4AVX2);
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels.emplace_back("avx512bw", &squaredL2x4AVX512BW);
+    }
+#endif
+    return kernels;
+}
+
+std::vector<std::pair<const char*, DotU8x4Kernel>> availableDotU8x4Kernels() {
+    std::vector<std::pair<const char*, DotU8x4Kernel>> kernels;
+    kernels.emplace_back("scalar", &dotU8x4Scalar);
+#ifdef K23_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.emplace_back("avx2", &dotU8x4AVX2);
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels.emplace_back("avx512bw", &dotU8x4AVX512BW);
+    }
+#endif
+    return kernels;
+}
+
+// Resolved once; every later call goes straight through the function pointer
+static const std::pair<const char*, SquaredL2Kernel>& selectedKernel() {
+    static const std::pair<const char*, SquaredL2Kernel> selected = availableSquaredL2Kernels().back();
+    return selected;
+}
+
+static SquaredL2x4Kernel selectedX4Kernel() {
+    static const SquaredL2x4Kernel selected = availableSquaredL2x4Kernels().back().second;
+    return selected;
+}
+
+static DotU8x4Kernel selectedDotX4Kernel() {
+    static const DotU8x4Kernel selected = availableDotU8x4Kernels().back().second;
+    return selected;
+}
+
+void dotU8x4(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]) {
+    selectedDotX4Kernel()(query, rows, n, out);
+}
+
+std::uint64_t squaredL2(const unsigned char* a, const unsigned char* b, std::size_t n) {
+    return selectedKernel().second(a, b, n);
+}
+
+std::uint64_t squaredL2Bounded(const unsigned char* a, const unsigned char* b, std::size_t n, std::uint64_t bound) {
+    SquaredL2Kernel kernel = selectedKernel().second;
+    if (bound == std::numeric_limits<std::uint64_t>::max()) {
+        return kernel(a, b, n);
+    }
+    std::uint64_t distance = 0;
+    for (std::size_t i = 0; i < n; i += kAbandonChunk) {
+        distance += kernel(a + i, b + i, std::min(kAbandonChunk, n - i));
+        if (distance > bound) {
+            break;
+        }
+    }
+    return distance;
+}
+
+void squaredL2x4Bounded(const unsigned char* query, const unsigned char* const rows[4], std::size_t n,
+                        std::uint64_t bound, std::uint64_t out[4]) {
+    SquaredL2x4Kernel kernel = selectedX4Kernel();
+    if (bound == std::numeric_limits<std::uint64_t>::max()) {
+        kernel(query, rows, n, out);
+        return;
+    }
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for (std::size_t i = 0; i < n; i += kAbandonChunk) {
+        const unsigned char* chunk_rows[4] = {rows[0] + i, rows[1] + i, rows[2] + i, rows[3] + i};
+        std::uint64_t partial[4];
+        kernel(query + i, chunk_rows, std::min(kAbandonChunk, n - i), partial);
+        for (int r = 0; r < 4; ++r) {
+            out[r] += partial[r];
+        }
+        if (out[0] > bound && out[1] > bound && out[2] > bound && out[3] > bound) {
+            break;
+        }
+    }
+}
+
+const char* squaredL2KernelName() {
+    return selectedKernel().first;
+}
@@ -0,0 +1,61 @@
+#ifndef PROJECT_K23_SEC_DISTANCE_KERNELS_H
+#define PROJECT_K23_SEC_DISTANCE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//
+// Squared L2 distance kernels for uint8 vectors.
+// All variants accumulate in integers, so they return exactly the same value.
+//
+
+using SquaredL2Kernel = std::uint64_t (*)(const unsigned char* a, const unsigned char* b, std::size_t n);
+
+std::uint64_t squaredL2Scalar(const unsigned char* a, const unsigned char* b, std::size_t n);
+std::uint64_t squaredL2SSE41(const unsigned char* a, const unsigned char* b, std::size_t n);
+std::uint64_t squaredL2AVX2(const unsigned char* a, const unsigned char* b, std::size_t n);
+std::uint64_t squaredL2AVX512BW(const unsigned char* a, const unsigned char* b, std::size_t n);
+std::uint64_t squaredL2AVX512VNNI(const unsigned char* a, const unsigned char* b, std::size_t n);
+
+// Four rows against one query in a single pass: each query chunk is loaded once and shared by the four rows.
+// out[r] receives the squared distance between query and rows[r].
+using SquaredL2x4Kernel = void (*)(const unsigned char* query, const unsigned char* const rows[4], std::size_t n,
+                                   std::uint64_t out[4]);
+
+void squaredL2x4Scalar(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+void squaredL2x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+void squaredL2x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+
+// Dot products of one query with four rows (integer accumulation, exact)
+using DotU8x4Kernel = void (*)(const unsigned char* query, const unsigned char* const rows[4], std::size_t n,
+                               std::uint64_t out[4]);
+
+void dotU8x4Scalar(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+void dotU8x4AVX2(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+void dotU8x4AVX512BW(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+
+// Four-row dot product using the fastest kernel supported by the CPU
+void dotU8x4(const unsigned char* query, const unsigned char* const rows[4], std::size_t n, std::uint64_t out[4]);
+
+// Squared L2 distance using the fastest kernel supported by the CPU (chosen once, on first use)
+std::uint64_t squaredL2(const unsigned char* a, const unsigned char* b, std::size_t n);
+
+// Same as squaredL2, but gives up once the partial sum exceeds bound and returns that partial sum.
+// Any result > bound therefore only means "farther than bound"; results <= bound are exact.
+std::uint64_t squaredL2Bounded(const unsigned char* a, const unsigned char* b, std::size_t n, std::uint64_t bound);
+
+// Four-row version of squaredL2Bounded; stops once all four partial sums exceed bound
+void squaredL2x4Bounded(const unsigned char* query, const unsigned char* const rows[4], std::size_t n,
+                        std::uint64_t bound, std::uint64_t out[4]);
+
+// Name of the kernel selected for this CPU
+const char* squaredL2KernelName();
+
+// Every kernel variant the running CPU can execute, fastest last
+std::vector<std::pair<const char*, SquaredL2Kernel>> availableSquaredL2Kernels();
+std::vector<std::pair<const char*, SquaredL2x4Kernel>> availableSquaredL2x4Kernels();
+std::vector<std::pair<const char*, DotU8x4Kernel>> availableDotU8x4Kernels();
+
+#endif //PROJECT_K23_SEC_DISTANCE_KERNELS_H
@@ -0,0 +1,84 @@
+#include "exact_knn.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include "distance_kernels.h"
+#include "global_functions.h"
+
+// Queries handled together by one task; they share every data block while it is in cache
+static constexpr std::size_t kQueryBlock = 16;
+// Data rows per block; 256 rows of 784 bytes fit comfortably in L2
+static constexpr std::size_t kDataBlock = 256;
+
+// ||x||^2 of every row, reusing the squared-L2 kernel against a zero vector
+static std::vector<std::uint64_t> squaredNorms(DatasetView rows) {
+    std::vector<unsigned char> zeros(rows.dimension(), 0);
+    std::vector<std::uint64_t> norms(rows.size());
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        norms[i] = squaredL2(rows.row(i), zeros.data(), rows.dimension());
+    }
+    return norms;
+}
+
+std::vector<std::vector<std::pair<int, double>>> exactKNearestNeighbors(DatasetView dataset, DatasetView queries,
+                                                                        int K, int num_threads) {
+    if (dataset.empty()) {
+        throw std::runtime_error("Dataset is empty.");
+    }
+    if (K <= 0) {
+        throw std::invalid_argument("K must be positive.");
+    }
+    if (queries.dimension() != dataset.dimension()) {
+        throw std::invalid_argument("Queries and dataset have different dimensions.");
+    }
+
+    const std::size_t n = dataset.size();
+    const std::size_t dim = dataset.dimension();
+    const std::vector<std::uint64_t> data_norms = squaredNorms(dataset);
+    const std::vector<std::uint64_t> query_norms = squaredNorms(queries);
+
+    std::vector<std::vector<std::pair<int, double>>> results(queries.size());
+
+    parallelFor(queries.size(), kQueryBlock, num_threads, [&](std::size_t q_begin, std::size_t q_end) {
+        std::vector<TopKHeap> nearest(q_end - q_begin, TopKHeap(K));
+        std::uint64_t dots[4];
+
+        for (std::size_t d_begin = 0; d_begin < n; d_begin += kDataBlock) {
+            const std::size_t d_end = std::min(n, d_begin + kDataBlock);
+
+            for (std::size_t q = q_begin; q < q_end; ++q) {
+                const unsigned char* query = queries.row(q);
+                TopKHeap& heap = nearest[q - q_begin];
+                std::uint64_t bound = heap.bound();
+                auto offer = [&](std::size_t index, std::uint64_t dot) {
+                    std::uint64_t distance = data_norms[index] + query_norms[q] - 2 * dot;
+                    if (distance < bound) {
+                        heap.push(distance, static_cast<int>(index));
+                        bound = heap.bound();
+                    }
+                };
+
+                std::size_t i = d_begin;
+                for (; i + 4 <= d_end; i += 4) {
+                    const unsigned char* rows[4] = {dataset.row(i), dataset.row(i + 1),
+                                                    dataset.row(i + 2), dataset.row(i + 3)};
+                    dotU8x4(query, rows, dim, dots);
+                    for (int r = 0; r < 4; ++r) {
+                        offer(i + r, dots[r]);
+                    }
+                }
+                for (; i < d_end; ++i) {
+                    const unsigned char* rows[4] = {dataset.row(i), dataset.row(i), dataset.row(i), dataset.row(i)};
+                    dotU8x4(query, rows, dim, dots);
+                    offer(i, dots[0]);
+                }
+            }
+        }
+
+        for (std::size_t q = q_begin; q < q_end; ++q) {
+            results[q] = nearest[q - q_begin].sortedResults();
+        }
+    });
+
+    return results;
+}
@@ -0,0 +1,16 @@
+#ifndef PROJECT_K23_SEC_EXACT_KNN_H
+#define PROJECT_K23_SEC_EXACT_KNN_H
+
+#include <utility>
+#include <vector>
+#include "dataset.h"
+
+// Exact K nearest neighbors of every query in a batch, for ground truth.
+// Distances are expanded as ||x||^2 - 2 x.q + ||q||^2: the norms are computed once and the dot products
+// run in cache-sized tiles (a block of queries against a block of data rows), spread over num_threads
+// threads (<= 0 means one per core). All arithmetic is integer, so results match trueNNearestNeighbors.
+// result[q] holds the neighbors of query q ordered from nearest to farthest, with true L2 distances.
+std::vector<std::vector<std::pair<int, double>>> exactKNearestNeighbors(DatasetView dataset, DatasetView queries,
+                                                                        int K, int num_threads = 0);
+
+#endif //PROJECT_K23_SEC_EXACT_KNN_H
@@ -0,0 +1,77 @@
+#include "file_mapping.h"
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile mapFile(const std::string& path, MappingHint hint) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file `" + path + "`!");
+    }
+
+    struct stat file_info{};
+    if (fstat(fd, &file_info) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not stat file `" + path + "`!");
+    }
+
+    MappedFile file;
+    file.size = static_cast<std::size_t>(file_info.st_size);
+    if (file.size == 0) {
+        close(fd);
+        return file;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (hint == MappingHint::Populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* mapping = mmap(nullptr, file.size, PROT_READ, flags, fd, 0);
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map file `" + path + "`!");
+    }
+
+    if (hint == MappingHint::WillNeed) {
+        madvise(mapping, file.size, MADV_WILLNEED);
+    } else if (hint == MappingHint::Sequential) {
+        madvise(mapping, file.size, MADV_SEQUENTIAL);
+    }
+
+    // Unmapped once the last owner is gone
+    const std::size_t size = file.size;
+    file.owner = std::shared_ptr<const void>(mapping, [size](const void* address) {
+        munmap(const_cast<void*>(address), size);
+    });
+    file.bytes = static_cast<const unsigned char*>(mapping);
+    return file;
+}
+
+#else
+
+#include <fstream>
+#include <vector>
+
+MappedFile mapFile(const std::string& path, MappingHint) {
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) {
+        throw std::runtime_error("Could not open file `" + path + "`!");
+    }
+    auto buffer = std::make_shared<std::vector<unsigned char>>(static_cast<std::size_t>(stream.tellg()));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char*>(buffer->data()), static_cast<std::streamsize>(buffer->size()));
+
+    MappedFile file;
+    file.size = buffer->size();
+    file.bytes = buffer->data();
+    file.owner = buffer;
+    return file;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PROJECT_K23_SEC_FILE_MAPPING_H
+#define PROJECT_K23_SEC_FILE_MAPPING_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// How a memory-mapped file should be paged in
+enum class MappingHint {
+    None,       // Pages are faulted in lazily on first access
+    Populate,   // Pre-fault the whole file while mapping it (MAP_POPULATE)
+    WillNeed,   // Start asynchronous read-ahead of the whole file (MADV_WILLNEED)
+    Sequential  // Aggressive read-ahead for front-to-back scans (MADV_SEQUENTIAL)
+};
+
+// A read-only view of a whole file. `owner` keeps the memory alive; hand it to Dataset::wrap
+// so the file stays mapped for as long as a dataset refers to it.
+struct MappedFile {
+    std::shared_ptr<const void> owner;
+    const unsigned char* bytes = nullptr;
+    std::size_t size = 0;
+};
+
+// Maps the file read-only. Without POSIX mmap the file is read into memory instead.
+MappedFile mapFile(const std::string& path, MappingHint hint = MappingHint::None);
+
+#endif //PROJECT_K23_SEC_FILE_MAPPING_H
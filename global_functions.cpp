@@ -1,10 +1,15 @@
 #include "global_functions.h"
+#include "distance_kernels.h"
 #include <vector>
 #include <cmath>
 #include <stdexcept>
 #include <random>
 #include <algorithm>
 #include <queue>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 
 //
@@ -19,28 +24,230 @@ double euclideanDistance(const std::vector<unsigned char>& dataset, const std::v
     if (dataset.size() != query_set.size()) {
         throw std::runtime_error("Vectors must have the same dimension for L2 distance calculation.");
     }
-    double distance = 0.0;
-    for (size_t i = 0; i < dataset.size(); ++i) {
-        double diff = static_cast<double>(dataset[i]) - static_cast<double>(query_set[i]);
-        distance += diff * diff;
+    // Integer accumulation through the SIMD kernel picked for this CPU
+    std::uint64_t distance = squaredL2(dataset.data(), query_set.data(), dataset.size());
+    return std::sqrt(static_cast<double>(distance));
+}
+
+std::uint64_t squaredEuclideanDistance(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b,
+                                       std::uint64_t bound) {
+    if (a.size() != b.size()) {
+        throw std::runtime_error("Vectors must have the same dimension for L2 distance calculation.");
+    }
+    return squaredL2Bounded(a.data(), b.data(), a.size(), bound);
+}
+
+std::uint64_t squaredEuclideanDistance(const unsigned char* a, const unsigned char* b, std::size_t n,
+                                       std::uint64_t bound) {
+    return squaredL2Bounded(a, b, n, bound);
+}
+
+// Touches every cache line of a row so it is on its way while earlier rows are being measured
+static void prefetchRow(const unsigned char* row, std::size_t n) {
+    for (std::size_t offset = 0; offset < n; offset += 64) {
+        __builtin_prefetch(row + offset);
+    }
+}
+
+void distancesToMany(DatasetView dataset, const unsigned char* query,
+                     const int* candidate_ids, std::size_t count, std::uint64_t* out, std::uint64_t bound) {
+    const std::size_t n = dataset.dimension();
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (std::size_t p = i + 4; p < std::min(count, i + 8); ++p) {
+            prefetchRow(dataset.row(candidate_ids[p]), n);
+        }
+        const unsigned char* rows[4] = {dataset.row(candidate_ids[i]), dataset.row(candidate_ids[i + 1]),
+                                        dataset.row(candidate_ids[i + 2]), dataset.row(candidate_ids[i + 3])};
+        squaredL2x4Bounded(query, rows, n, bound, out + i);
+    }
+    for (; i < count; ++i) {
+        out[i] = squaredL2Bounded(query, dataset.row(candidate_ids[i]), n, bound);
+    }
+}
+
+void distancesToMany(DatasetView dataset, const unsigned char* query,
+                     const std::vector<int>& candidate_ids, std::vector<std::uint64_t>& out, std::uint64_t bound) {
+    out.resize(candidate_ids.size());
+    distancesToMany(dataset, query, candidate_ids.data(), candidate_ids.size(), out.data(), bound);
+}
+
+void scanCandidates(DatasetView dataset, const unsigned char* query,
+                    const std::vector<int>& candidate_ids, TopKHeap& nearest) {
+    constexpr std::size_t batch_size = 32;
+    std::uint64_t distances[batch_size];
+    for (std::size_t start = 0; start < candidate_ids.size(); start += batch_size) {
+        std::size_t count = std::min(batch_size, candidate_ids.size() - start);
+        distancesToMany(dataset, query, candidate_ids.data() + start, count, distances, nearest.bound());
+        for (std::size_t i = 0; i < count; ++i) {
+            nearest.push(distances[i], candidate_ids[start + i]);
+        }
+    }
+}
+
+std::size_t scanWithinRadius(DatasetView dataset, const unsigned char* query, const std::vector<int>& candidate_ids,
+                             std::uint64_t squared_radius, const std::function<void(int, double)>& visit,
+                             std::size_t max_results) {
+    constexpr std::size_t batch_size = 64;
+    std::uint64_t distances[batch_size];
+    std::size_t reported = 0;
+    for (std::size_t start = 0; start < candidate_ids.size() && reported < max_results; start += batch_size) {
+        const std::size_t count = std::min(batch_size, candidate_ids.size() - start);
+        distancesToMany(dataset, query, candidate_ids.data() + start, count, distances, squared_radius);
+        for (std::size_t i = 0; i < count && reported < max_results; ++i) {
+            if (distances[i] <= squared_radius) {
+                visit(candidate_ids[start + i], std::sqrt(static_cast<double>(distances[i])));
+                ++reported;
+            }
+        }
+    }
+    return reported;
+}
+
+VisitedSet::VisitedSet(std::size_t capacity) : stamps(capacity, 0) {}
+
+void VisitedSet::clear(std::size_t capacity) {
+    if (stamps.size() < capacity) {
+        stamps.resize(capacity, 0);
+    }
+    if (++epoch == 0) {
+        // The epoch wrapped around, so old stamps could look current: reset them all
+        std::fill(stamps.begin(), stamps.end(), 0);
+        epoch = 1;
+    }
+}
+
+bool VisitedSet::insert(int index) {
+    std::uint32_t& stamp = stamps[index];
+    if (stamp == epoch) {
+        return false;
+    }
+    stamp = epoch;
+    return true;
+}
+
+PerturbationSequence::PerturbationSequence(const std::vector<double>& scores) : order(scores.size()) {
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<int>(i);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return scores[a] < scores[b]; });
+    sorted_scores.reserve(scores.size());
+    for (int index : order) {
+        sorted_scores.push_back(scores[index]);
+    }
+    if (!sorted_scores.empty()) {
+        heap.push_back({sorted_scores[0], {0}});
+    }
+}
+
+double PerturbationSequence::peekScore() const {
+    return heap.empty() ? std::numeric_limits<double>::infinity() : heap.front().first;
+}
+
+bool PerturbationSequence::next(std::vector<int>& subset) {
+    if (heap.empty()) {
+        return false;
+    }
+    std::pop_heap(heap.begin(), heap.end(), ScoreGreater());
+    Candidate current = std::move(heap.back());
+    heap.pop_back();
+
+    // Every subset is reached exactly once from {0} by these two moves on its largest position
+    const int last = current.second.back();
+    if (last + 1 < static_cast<int>(sorted_scores.size())) {
+        // Shift: replace the largest position with the next one
+        Candidate shifted = current;
+        shifted.first += sorted_scores[last + 1] - sorted_scores[last];
+        shifted.second.back() = last + 1;
+        heap.push_back(std::move(shifted));
+        std::push_heap(heap.begin(), heap.end(), ScoreGreater());
+
+        // Expand: also take the next position
+        Candidate expanded = current;
+        expanded.first += sorted_scores[last + 1];
+        expanded.second.push_back(last + 1);
+        heap.push_back(std::move(expanded));
+        std::push_heap(heap.begin(), heap.end(), ScoreGreater());
+    }
+
+    subset.clear();
+    for (int position : current.second) {
+        subset.push_back(order[position]);
+    }
+    return true;
+}
+
+std::uint64_t squaredRadius(double radius) {
+    if (radius < 0) {
+        throw std::invalid_argument("Radius must be non-negative.");
+    }
+    // Squared distances are integers, so d <= radius exactly when d^2 <= floor(radius^2)
+    double squared = std::floor(radius * radius);
+    if (squared >= static_cast<double>(std::numeric_limits<std::uint64_t>::max())) {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+    return static_cast<std::uint64_t>(squared);
+}
+
+TopKHeap::TopKHeap(int K) : K(K) {
+    if (K <= 0) {
+        throw std::invalid_argument("K must be positive.");
+    }
+    heap.reserve(K);
+}
+
+bool TopKHeap::full() const {
+    return heap.size() == K;
+}
+
+std::size_t TopKHeap::size() const {
+    return heap.size();
+}
+
+std::uint64_t TopKHeap::bound() const {
+    return full() ? heap.front().first : std::numeric_limits<std::uint64_t>::max();
+}
+
+void TopKHeap::push(std::uint64_t distance, int index) {
+    if (!full()) {
+        heap.emplace_back(distance, index);
+        std::push_heap(heap.begin(), heap.end());
+    } else if (distance < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {distance, index};
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+std::vector<std::pair<int, double>> TopKHeap::sortedResults() const {
+    std::vector<std::pair<std::uint64_t, int>> sorted(heap);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<std::pair<int, double>> results;
+    results.reserve(sorted.size());
+    for (const auto& [distance, index] : sorted) {
+        results.emplace_back(index, std::sqrt(static_cast<double>(distance)));
     }
-    return std::sqrt(distance);
+    return results;
 }
 
 int computeDPrime(int n) {
+    std::random_device rd;
+    std::mt19937 mt(rd());
+    return computeDPrime(n, mt);
+}
+
+int computeDPrime(int n, std::mt19937& generator) {
     int logValue = static_cast<int>(std::log2(n));
     int d_prime_lower_bound = logValue - 3;
     int d_prime_upper_bound = logValue - 1;
 
-    std::random_device rd;
-    std::mt19937 mt(rd());
     std::uniform_int_distribution<int> dist(d_prime_lower_bound, d_prime_upper_bound);
 
-    return dist(mt);
+    return dist(generator);
 }
 
-std::vector<std::pair<int, double>> trueNNearestNeighbors(const std::vector<std::vector<unsigned char>>& dataset,
-                                                          const std::vector<unsigned char>& query_point, int N) {
+std::vector<std::pair<int, double>> trueNNearestNeighbors(DatasetView dataset, const unsigned char* query_point, int N) {
     // Check for dataset's emptiness
     if (dataset.empty()) {
         throw std::runtime_error("Dataset is empty.");
@@ -50,31 +257,63 @@ std::vector<std::pair<int, double>> trueNNearestNeighbors(const std::vector<std:
         throw std::invalid_argument("N must be positive.");
     }
 
-    // Pair: distance, index. We use distance as the key for the priority queue.
-    std::priority_queue<std::pair<double, int>> max_heap;
-
+    TopKHeap nearest(N);
     for (int i = 0; i < dataset.size(); ++i) {
-        double distance = euclideanDistance(dataset[i], query_point);
-
-        // If we haven't yet found N neighbors, or the current point is closer than the farthest neighbor found so far.
-        if (max_heap.size() < N || distance < max_heap.top().first) {
-            if (max_heap.size() == N) {
-                max_heap.pop(); // Remove the farthest neighbor
-            }
-            max_heap.emplace(distance, i); // Add the current point
-        }
+        // Points farther than the current N-th best are abandoned part-way through
+        std::uint64_t distance = squaredEuclideanDistance(dataset.row(i), query_point, dataset.dimension(),
+                                                          nearest.bound());
+        nearest.push(distance, i);
     }
 
-    std::vector<std::pair<int, double>> nearest_neighbors;
-    while (!max_heap.empty()) {
-        nearest_neighbors.emplace_back(max_heap.top().second, max_heap.top().first);
-        max_heap.pop();
+    return nearest.sortedResults();
+}
+
+int defaultThreadCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores == 0 ? 1 : static_cast<int>(cores);
+}
+
+void parallelFor(std::size_t count, std::size_t chunk, int num_threads,
+                 const std::function<void(std::size_t, std::size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    chunk = std::max<std::size_t>(1, chunk);
+    const std::size_t num_chunks = (count + chunk - 1) / chunk;
+    if (num_threads <= 0) {
+        num_threads = defaultThreadCount();
     }
+    num_threads = static_cast<int>(std::min<std::size_t>(num_threads, num_chunks));
 
-    // The priority queue will order from largest to smallest distance. So, reverse for correct ordering.
-    std::reverse(nearest_neighbors.begin(), nearest_neighbors.end());
+    std::atomic<std::size_t> next_chunk{0};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto worker = [&]() {
+        try {
+            for (std::size_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+                body(c * chunk, std::min(count, (c + 1) * chunk));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            next_chunk = num_chunks; // Stop handing out work
+        }
+    };
 
-    return nearest_neighbors;
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (int t = 1; t < num_threads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker(); // The calling thread works too
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
 }
 
 std::vector<unsigned char> convertToUnsignedChar(const std::vector<double>& vec) {
@@ -6,17 +6,142 @@
 #define PROJECTEM_GLOBAL_FUNCTIONS_H
 
 #include <vector>
-
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
+#include <functional>
+#include <random>
+#include "dataset.h"
 
 
 double euclideanDistance(const std::vector<unsigned char>& dataset, const std::vector<unsigned char>& query_set);
+
+// Squared L2 distance, the form used internally for every comparison.
+// With a bound, the evaluation stops early and any result > bound only means "farther than bound".
+std::uint64_t squaredEuclideanDistance(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b,
+                                       std::uint64_t bound = std::numeric_limits<std::uint64_t>::max());
+std::uint64_t squaredEuclideanDistance(const unsigned char* a, const unsigned char* b, std::size_t n,
+                                       std::uint64_t bound = std::numeric_limits<std::uint64_t>::max());
+
+// Squared distances from one query to many dataset rows: out[i] belongs to candidate_ids[i].
+// Rows are measured four at a time against a shared query chunk while the next rows are prefetched.
+// The bound has the same meaning as in squaredEuclideanDistance.
+void distancesToMany(DatasetView dataset, const unsigned char* query,
+                     const int* candidate_ids, std::size_t count, std::uint64_t* out,
+                     std::uint64_t bound = std::numeric_limits<std::uint64_t>::max());
+void distancesToMany(DatasetView dataset, const unsigned char* query,
+                     const std::vector<int>& candidate_ids, std::vector<std::uint64_t>& out,
+                     std::uint64_t bound = std::numeric_limits<std::uint64_t>::max());
+
+// Largest squared distance that still lies within the given radius
+std::uint64_t squaredRadius(double radius);
+
+// Fixed-capacity max-heap holding the K smallest squared distances seen so far.
+// Its worst kept distance is the bound a new candidate has to beat.
+class TopKHeap {
+public:
+    explicit TopKHeap(int K);
+
+    [[nodiscard]] bool full() const;
+    [[nodiscard]] std::size_t size() const;
+    [[nodiscard]] std::uint64_t bound() const;
+
+    // Keeps (distance, index) if it beats the current bound
+    void push(std::uint64_t distance, int index);
+
+    // Results ordered from nearest to farthest, with distances converted back to true L2
+    [[nodiscard]] std::vector<std::pair<int, double>> sortedResults() const;
+
+private:
+    std::size_t K;
+    std::vector<std::pair<std::uint64_t, int>> heap;
+};
+
+// Set of visited point indices that is emptied in O(1): each slot holds the epoch in which it was
+// last visited, and clear() starts a new epoch. Meant to be kept and reused across queries.
+class VisitedSet {
+public:
+    explicit VisitedSet(std::size_t capacity = 0);
+
+    // Forgets every visit and makes room for indices in [0, capacity)
+    void clear(std::size_t capacity);
+
+    // Marks index as visited; returns false if it already was
+    bool insert(int index);
+
+private:
+    std::vector<std::uint32_t> stamps;
+    std::uint32_t epoch = 1;
+};
+
+// Enumerates the non-empty subsets of a set of perturbations in increasing order of total score
+// (the shift/expand scheme of multi-probe LSH), so the most promising probes come first.
+// Subsets come out as indices into the scores given to the constructor; telling apart subsets that
+// are not valid probes (e.g. moving one function both up and down) is left to the caller.
+class PerturbationSequence {
+public:
+    explicit PerturbationSequence(const std::vector<double>& scores);
+
+    // Score of the next subset, or +infinity when all subsets have been produced
+    [[nodiscard]] double peekScore() const;
+
+    // Writes the next subset and returns false once there are none left
+    bool next(std::vector<int>& subset);
+
+private:
+    // Subsets are kept as ascending positions in the sorted order
+    using Candidate = std::pair<double, std::vector<int>>;
+    struct ScoreGreater {
+        bool operator()(const Candidate& a, const Candidate& b) const { return a.first > b.first; }
+    };
+
+    std::vector<double> sorted_scores;
+    std::vector<int> order; // order[position] is the caller's index of the score at that position
+    std::vector<Candidate> heap; // Min-heap on the score
+};
+
 std::vector<unsigned char> convertToUnsignedChar(const std::vector<double>& vec);
 
 
 int computeDPrime(int n);
-std::vector<std::pair<int, double>> trueNNearestNeighbors(const std::vector<std::vector<unsigned char>>& dataset,
-                                                          const std::vector<unsigned char>& query_point, int N);
+// Same, drawing from the caller's generator so that seeded indexes are reproducible
+int computeDPrime(int n, std::mt19937& generator);
+std::vector<std::pair<int, double>> trueNNearestNeighbors(DatasetView dataset, const unsigned char* query_point, int N);
+
+
+// Number of worker threads to use when the caller asks for num_threads <= 0 (one per core)
+int defaultThreadCount();
+
+// Runs body(begin, end) over [0, count) in chunks of `chunk` items, handed out dynamically to num_threads
+// threads (<= 0 means one per core). Runs inline when a single thread is enough.
+void parallelFor(std::size_t count, std::size_t chunk, int num_threads,
+                 const std::function<void(std::size_t, std::size_t)>& body);
+
+// Runs search(query, scratch) for every row of queries on num_threads threads. Threads take small runs
+// of queries, and each run reuses one default-constructed Scratch. result[i] belongs to queries.row(i).
+template <typename Scratch, typename Search>
+std::vector<std::vector<std::pair<int, double>>> searchBatch(DatasetView queries, int num_threads, Search search) {
+    std::vector<std::vector<std::pair<int, double>>> results(queries.size());
+    parallelFor(queries.size(), 16, num_threads, [&](std::size_t begin, std::size_t end) {
+        Scratch scratch;
+        for (std::size_t i = begin; i < end; ++i) {
+            results[i] = search(queries.row(i), scratch);
+        }
+    });
+    return results;
+}
+
+// Measures every candidate with distancesToMany and offers it to nearest.
+// Candidates go in small batches so the pruning bound tightens as the heap fills up.
+void scanCandidates(DatasetView dataset, const unsigned char* query,
+                    const std::vector<int>& candidate_ids, TopKHeap& nearest);
+
+// Calls visit(id, distance) for every candidate within squared_radius of the query, and stops after
+// max_results hits. Returns the number of hits. Candidates are measured a batch at a time, so a search
+// that hits its limit early stops measuring too.
+std::size_t scanWithinRadius(DatasetView dataset, const unsigned char* query, const std::vector<int>& candidate_ids,
+                             std::uint64_t squared_radius, const std::function<void(int, double)>& visit,
+                             std::size_t max_results);
 
 
 #endif //PROJECTEM_GLOBAL_FUNCTIONS_H
@@ -1,11 +1,12 @@
 #include <iostream>
 #include <algorithm> // Include for sorting and other algorithms
 #include <random> // Include for random number generation
+#include <cmath>
 #include "graph.h"
 #include "global_functions.h"
 
 // Constructor for the Graph class, initializes the graph with a given size
-Graph::Graph(int size) : nodes(size) {}
+Graph::Graph(DatasetView points) : nodes(points.size()), dataPoints(points) {}
 
 // Function to add an edge between two nodes in the graph
 void Graph::addEdge(int src, int dest) {
@@ -19,12 +20,10 @@ const std::set<int>& Graph::getNeighbors(int nodeIndex) const {
 
 // Function to build a k-Nearest Neighbors Graph using LSH
 Graph buildKNNG(LSH &lsh, int k, int datasetSize) {
-    Graph kNNG(datasetSize);
+    Graph kNNG(lsh.getDataset().head(datasetSize));
 
     for (int i = 0; i < datasetSize; ++i) {
-        const std::vector<unsigned char>& queryPoint = lsh.getDataset()[i];
-
-        kNNG.storePoint(queryPoint);
+        const unsigned char* queryPoint = lsh.getDataset().row(i);
 
         // Query for the k nearest neighbors of the point
         auto neighbors = lsh.queryNNearestNeighbors(queryPoint, k);
@@ -41,16 +40,12 @@ Graph buildKNNG(LSH &lsh, int k, int datasetSize) {
 
 // Function to build a k-Nearest Neighbors Graph using Hypercube method
 Graph buildKNNG_H(Hypercube &hypercube, int k, int datasetSize) {
-    Graph kNNG(datasetSize);
+    Graph kNNG(hypercube.getDataset().head(datasetSize));
 
+    // The k nearest neighbors of all points are queried in parallel, then the edges are added in order
+    auto allNeighbors = hypercube.kNearestNeighborsBatch(hypercube.getDataset().head(datasetSize), k);
     for (int i = 0; i < datasetSize; ++i) {
-        const std::vector<unsigned char>& queryPoint = hypercube.getDataset()[i];
-
-        kNNG.storePoint(queryPoint);
-
-        // Query for the k nearest neighbors of the point
-        auto neighbors = hypercube.kNearestNeighbors(queryPoint, k);
-        for (const auto& neighbor : neighbors) {
+        for (const auto& neighbor : allNeighbors[i]) {
             int neighborIndex = neighbor.first;
             kNNG.addEdge(i, neighborIndex); // Add edges to the graph
         }
@@ -61,14 +56,9 @@ Graph buildKNNG_H(Hypercube &hypercube, int k, int datasetSize) {
 
 
 
-// Function to store a point in the graph
-void Graph::storePoint(const std::vector<unsigned char>& point) {
-    dataPoints.push_back(point);
-}
-
 // Function to get a point from the graph using its node index
-const std::vector<unsigned char>& Graph::getPoint(int nodeIndex) const {
-    return dataPoints[nodeIndex];
+const unsigned char* Graph::getPoint(int nodeIndex) const {
+    return dataPoints.row(nodeIndex);
 }
 
 // Function to get the size of the graph
@@ -78,8 +68,11 @@ std::size_t Graph::size() const {
 
 
 // Greedy Nearest Neighbor Search (GNNS) function
-std::vector<std::pair<int, double>> Graph::GNNS(const std::vector<unsigned char>& queryPoint, int N, int R, int T, int E) const {
-    std::vector<std::pair<int, double>> potentialNeighbors;
+std::vector<std::pair<int, double>> Graph::GNNS(const unsigned char* queryPoint, int N, int R, int T, int E) const {
+    // Distances stay squared during the search; only the returned neighbors are converted to true L2
+    std::vector<std::pair<int, std::uint64_t>> potentialNeighbors;
+    std::vector<int> expanded;
+    std::vector<std::uint64_t> distances;
 
     std::random_device rd;
     std::default_random_engine engine(rd());
@@ -91,21 +84,26 @@ std::vector<std::pair<int, double>> Graph::GNNS(const std::vector<unsigned char>
         for (int t = 0; t < T; ++t) {
             const auto& neighbors = this->getNeighbors(currentNode);
             int bestNeighbor = currentNode;
-            double bestDistance = euclideanDistance(this->getPoint(currentNode), queryPoint);
+            std::uint64_t bestDistance = squaredEuclideanDistance(this->getPoint(currentNode), queryPoint,
+                                                                  dataPoints.dimension());
             bool isLocalOptimal = true;
 
-            int count = 0;
+            // Measure the first E neighbors in one batch
+            expanded.clear();
             for (int neighbor : neighbors) {
-                if (count >= E) break;
-                double distance = euclideanDistance(this->getPoint(neighbor), queryPoint);
-                potentialNeighbors.emplace_back(neighbor, distance); // Store each neighbor along with the distance
+                if (expanded.size() >= E) break;
+                expanded.push_back(neighbor);
+            }
+            distancesToMany(dataPoints, queryPoint, expanded, distances);
 
-                if (distance < bestDistance) {
-                    bestDistance = distance;
-                    bestNeighbor = neighbor;
+            for (std::size_t i = 0; i < expanded.size(); ++i) {
+                potentialNeighbors.emplace_back(expanded[i], distances[i]); // Store each neighbor along with the distance
+
+                if (distances[i] < bestDistance) {
+                    bestDistance = distances[i];
+                    bestNeighbor = expanded[i];
                     isLocalOptimal = false;
                 }
-                count++;
             }
 
             // Terminate early if current node is better than its neighbors (local optimal)
@@ -119,13 +117,13 @@ std::vector<std::pair<int, double>> Graph::GNNS(const std::vector<unsigned char>
 
     // Sort potential neighbors based on their distance to the query point
     std::sort(potentialNeighbors.begin(), potentialNeighbors.end(),
-              [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+              [](const std::pair<int, std::uint64_t>& a, const std::pair<int, std::uint64_t>& b) {
                   return a.second < b.second;
               });
 
     // Remove duplicate entries from the list of potential neighbors
     auto last = std::unique(potentialNeighbors.begin(), potentialNeighbors.end(),
-                            [](const std::pair<int, double>& a, const std::pair<int, double>& b){
+                            [](const std::pair<int, std::uint64_t>& a, const std::pair<int, std::uint64_t>& b){
                                 return a.first == b.first;
                             });
     potentialNeighbors.erase(last, potentialNeighbors.end());
@@ -135,5 +133,10 @@ std::vector<std::pair<int, double>> Graph::GNNS(const std::vector<unsigned char>
         potentialNeighbors.resize(N);
     }
 
-    return potentialNeighbors;
+    std::vector<std::pair<int, double>> nearestNeighbors;
+    nearestNeighbors.reserve(potentialNeighbors.size());
+    for (const auto& [index, distance] : potentialNeighbors) {
+        nearestNeighbors.emplace_back(index, std::sqrt(static_cast<double>(distance)));
+    }
+    return nearestNeighbors;
 }
@@ -9,6 +9,7 @@
 #include <set>
 #include "lsh_class.h" // Include your LSH class header
 #include "Hypercube.h" // Include your Hypercube class header
+#include "dataset.h"
 
 
 // Define a Node for the Graph
@@ -19,17 +20,15 @@ struct Node {
 // Define the Graph class
 class Graph {
 public:
-    explicit Graph(int size);
+    explicit Graph(DatasetView points); // One node per point of the shared dataset
     void addEdge(int src, int dest);
     [[nodiscard]] const std::set<int>& getNeighbors(int nodeIndex) const;
     [[nodiscard]] std::size_t size() const; // Returns the number of nodes in the graph
-    [[nodiscard]] const std::vector<unsigned char>& getPoint(int nodeIndex) const; // Returns the data point for a given node
-    // Method to store a data point
-    void storePoint(const std::vector<unsigned char>& point);
-    [[nodiscard]] std::vector<std::pair<int, double>> GNNS(const std::vector<unsigned char>& queryPoint, int K, int R, int T, int E) const;
+    [[nodiscard]] const unsigned char* getPoint(int nodeIndex) const; // Returns the data point for a given node
+    [[nodiscard]] std::vector<std::pair<int, double>> GNNS(const unsigned char* queryPoint, int K, int R, int T, int E) const;
 private:
     std::vector<Node> nodes;
-    std::vector<std::vector<unsigned char>> dataPoints;
+    DatasetView dataPoints; // Not owned
 
 };
 
@@ -3,29 +3,36 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <algorithm>
 #include "mnist.h"
+#include "vecs_io.h"
 #include "lsh_class.h"
 #include "Hypercube.h"
 #include "global_functions.h"
 #include "graph.h"
 #include "MRNGGraph.h"
+#include "ground_truth.h"
+#include "tuner.h"
 
 int main(int argc, char** argv) {
     std::vector<std::string> args(argv, argv + argc);
 
     std::string inputFile, queryFile, outputFile;
-    int number_of_images, image_size;
     int k = 50; // Number of nearest neighbors in graph
     int E = 30; // Number of expansions
     int R = 1; // Number of random restarts
     int N = 1;  // Number of nearest neighbors to search for
     int l = 20;  // Only for Search-on-Graph
-    int mode = 0; // 1 for GNNS, 2 for MRNG
+    int mode = 0; // 1 for GNNS, 2 for MRNG, 3 to tune LSH/Hypercube parameters
+    double targetRecall = 0.9; // Only for tuning: the recall@N to reach
+    int numQueries = 10; // Number of queries to evaluate
+    std::string groundTruthCache = "gt_cache"; // Directory holding cached exact neighbors
+    MappingHint mappingHint = MappingHint::None; // How the memory-mapped input files are paged in
 
     char repeatChoice = 'n'; // to control the loop
     do {
         if (args.size() == 1) {  // Only mode provided, prompt for paths
-            std::cout << "Please enter the mode (1 for GNNS, 2 for MRNG): ";
+            std::cout << "Please enter the mode (1 for GNNS, 2 for MRNG, 3 for tuning): ";
             std::cin >> mode;
             std::cout << "Enter the path to the dataset: ";
             std::cin >> inputFile;
@@ -49,18 +56,37 @@ int main(int argc, char** argv) {
                     l = std::stoi(args[++i]);
                 } else if (args[i] == "-m") {
                     mode = std::stoi(args[++i]);
+                } else if (args[i] == "-nq") {
+                    numQueries = std::stoi(args[++i]);
+                    if (numQueries <= 0) {
+                        std::cerr << "The number of queries (-nq) must be positive." << std::endl;
+                        return 2;
+                    }
+                } else if (args[i] == "-target") {
+                    targetRecall = std::stod(args[++i]);
+                } else if (args[i] == "-gtcache") {
+                    groundTruthCache = args[++i];
+                } else if (args[i] == "-populate") {
+                    mappingHint = MappingHint::Populate;
+                } else if (args[i] == "-willneed") {
+                    mappingHint = MappingHint::WillNeed;
                 }
             }
         }
 
-        std::vector<std::vector<unsigned char>> dataset = read_mnist_images(inputFile, number_of_images, image_size);
+        // idx (MNIST) and .bvecs files are memory-mapped and read in place; .fvecs/.ivecs are converted to uint8
+        Dataset dataset = load_dataset(inputFile, mappingHint);
 
         if (queryFile.empty()) {
             std::cout << "Enter the path to the query file: ";
             std::cin >> queryFile;
         }
 
-        std::vector<std::vector<unsigned char>> query_set = read_mnist_images(queryFile, number_of_images, image_size);
+        Dataset query_set = load_dataset(queryFile, mappingHint);
+        if (query_set.dimension() != dataset.dimension()) {
+            std::cerr << "Query vectors and dataset vectors have different dimensions." << std::endl;
+            return 2;
+        }
 
         if (outputFile.empty()) {
             std::cout << "Enter the path for output file: ";
@@ -73,6 +99,23 @@ int main(int argc, char** argv) {
             return 2;
         }
 
+        if (query_set.size() == 0) {
+            std::cerr << "The query file contains no vectors." << std::endl;
+            return 2;
+        }
+        numQueries = std::min<int>(numQueries, static_cast<int>(query_set.size()));
+
+        // Exact neighbors for all evaluated queries in one parallel, blocked pass; reused from the cache
+        // when the same dataset and query files were evaluated before
+        bool groundTruthCached = false;
+        auto startTimeTrue = std::chrono::high_resolution_clock::now();
+        auto allTrueResults = cachedGroundTruth(inputFile, queryFile, dataset, query_set.view().head(numQueries), N,
+                                                groundTruthCache, &groundTruthCached);
+        auto endTimeTrue = std::chrono::high_resolution_clock::now();
+        std::cout << (groundTruthCached ? "Loaded cached ground truth from " : "Stored ground truth in ")
+                  << groundTruthCache << std::endl;
+        double tTrue = std::chrono::duration<double, std::milli>(endTimeTrue - startTimeTrue).count() / 1000.0 / numQueries;
+
         double totalTAlgorithm = 0.0;
         double totalTTrue = 0.0;
         double totalMAF = 0.0;
@@ -80,12 +123,11 @@ int main(int argc, char** argv) {
 
         if (mode == 1) {
 
-            std::vector<std::vector<unsigned char>> testset;
-
             int T = 10; // Number of greedy steps
 
             LSH lsh(dataset);
-            //Hypercube cube(testset);
+            lsh.printBucketStatistics(std::cout);
+            //Hypercube cube(dataset);
             std::cout << "Started building the k-NNG" << std::endl;
             Graph kNNG_L = buildKNNG(lsh, k, dataset.size());
             //Graph kNNG_L = buildKNNG_H(cube, k, dataset.size());
@@ -93,20 +135,16 @@ int main(int argc, char** argv) {
             std::cout << "Finished building the k-NNG." << std::endl;
             outputFileStream << "GNNS Results" << std::endl;
 
-            for (int i = 0; i < 10; ++i) {
+            for (int i = 0; i < numQueries; ++i) {
                 outputFileStream << "\nQuery: " << i << std::endl;
 
                 auto startTimeAlgorithm = std::chrono::high_resolution_clock::now();
-                auto results = kNNG_L.GNNS(query_set[i], N, R, T, E);
+                auto results = kNNG_L.GNNS(query_set.row(i), N, R, T, E);
                 auto endTimeAlgorithm = std::chrono::high_resolution_clock::now();
 
                 double tAlgorithm = std::chrono::duration<double, std::milli>(endTimeAlgorithm - startTimeAlgorithm).count() / 1000.0;
 
-                auto startTimeTrue = std::chrono::high_resolution_clock::now();
-                auto trueResults = trueNNearestNeighbors(dataset, query_set[i], N);
-                auto endTimeTrue = std::chrono::high_resolution_clock::now();
-
-                double tTrue = std::chrono::duration<double, std::milli>(endTimeTrue - startTimeTrue).count() / 1000.0;
+                const auto& trueResults = allTrueResults[i];
 
                 for (int j = 0; j < N; ++j) {
                     double distanceApproximate = results[j].second;
@@ -128,34 +166,27 @@ int main(int argc, char** argv) {
 
 
         }   else if (mode == 2) {
-            std::vector<std::vector<unsigned char>> testset;
-            for (int i = 0; i < 3000; ++i) {
-                testset.push_back(dataset[i]);
-            }
+            // The MRNG is built over the first 3000 points of the shared dataset
+            DatasetView testset = dataset.view().head(std::min<std::size_t>(3000, dataset.size()));
             std::cout << "Started building the MRNG" << std::endl;
             MRNGGraph mrngGraph(testset, l, N);
             std::cout << "Finished building the MRNG." << std::endl;
             outputFileStream << "MRNG Results" << std::endl;
 
 
-            for (int i = 0; i < 10; ++i) {
+            for (int i = 0; i < numQueries; ++i) {
                 outputFileStream << "\nQuery: " << i << std::endl;
 
                 // Start time for MRNG algorithm
                 auto startTimeAlgorithm = std::chrono::high_resolution_clock::now();
-                auto results = mrngGraph.searchOnGraph(query_set[i], 0, N, l);
+                auto results = mrngGraph.searchOnGraph(query_set.row(i), 0, N, l);
                 auto endTimeAlgorithm = std::chrono::high_resolution_clock::now();
 
                 // Calculate the time taken by the MRNG algorithm
                 double tAlgorithm = std::chrono::duration<double, std::milli>(endTimeAlgorithm - startTimeAlgorithm).count() / 1000.0;
 
-                // Start time for true nearest neighbors search
-                auto startTimeTrue = std::chrono::high_resolution_clock::now();
-                auto trueResults = trueNNearestNeighbors(dataset, query_set[i], N);
-                auto endTimeTrue = std::chrono::high_resolution_clock::now();
-
-                // Calculate the time taken by the true nearest neighbors search
-                double tTrue = std::chrono::duration<double, std::milli>(endTimeTrue - startTimeTrue).count() / 1000.0;
+                // True nearest neighbors come from the batch computed above
+                const auto& trueResults = allTrueResults[i];
 
                 for (int j = 0; j < N; ++j) {
                     double distanceApproximate = results[j].second;
@@ -175,17 +206,36 @@ int main(int argc, char** argv) {
             }
 
 
+        }   else if (mode == 3) {
+            // Searches the LSH and Hypercube parameter grids against the exact neighbors of the query sample
+            TuningOptions options;
+            options.K = N;
+            options.target_recall = targetRecall;
+            DatasetView sample = query_set.view().head(numQueries);
+
+            std::cout << "Started tuning on " << numQueries << " queries" << std::endl;
+            auto configurations = tuneLSH(dataset, sample, allTrueResults, options);
+            auto cubeConfigurations = tuneHypercube(dataset, sample, allTrueResults, options);
+            configurations.insert(configurations.end(), cubeConfigurations.begin(), cubeConfigurations.end());
+            std::cout << "Finished tuning." << std::endl;
+
+            outputFileStream << "Tuning Results (recall@" << N << ")" << std::endl;
+            printTuningReport(outputFileStream, configurations, targetRecall);
+            printTuningReport(std::cout, configurations, targetRecall);
         }
 
-        // Calculate the average values for the 10 queries
+        if (mode != 3) {
+            // Calculate the average values over the evaluated queries
 
-        totalTAlgorithm /= 10;
-        totalTTrue /= 10;
+            totalTAlgorithm /= numQueries;
+            totalTTrue /= numQueries;
 
-        outputFileStream << std::endl;
-        outputFileStream << "tAverageApproximate: " << totalTAlgorithm << std::endl;
-        outputFileStream << "tAverageTrue: " << totalTTrue << std::endl;
-        outputFileStream << "MAF: " << maxApproximationFactor << std::endl;
+            outputFileStream << std::endl;
+            outputFileStream << "tAverageApproximate: " << totalTAlgorithm << std::endl;
+            outputFileStream << "tAverageTrue: " << totalTTrue
+                             << (groundTruthCached ? " (loaded from the ground-truth cache)" : "") << std::endl;
+            outputFileStream << "MAF: " << maxApproximationFactor << std::endl;
+        }
 
 
         // Ask the user if they want to repeat with new files
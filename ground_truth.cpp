@@ -0,0 +1,105 @@
+#include "ground_truth.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "exact_knn.h"
+#include "file_mapping.h"
+#include "global_functions.h"
+#include "vecs_io.h"
+
+static constexpr std::uint64_t kFnvOffset = 14695981039346656037ULL;
+static constexpr std::uint64_t kFnvPrime = 1099511628211ULL;
+
+static std::uint64_t fnv1a(const unsigned char* bytes, std::size_t size, std::uint64_t hash) {
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    }
+    return hash;
+}
+
+std::uint64_t hashFileContents(const std::string& path) {
+    MappedFile file = mapFile(path, MappingHint::Sequential);
+    return fnv1a(file.bytes, file.size, kFnvOffset);
+}
+
+// Loads a cached ground truth if it is complete and consistent with the inputs; the distances are
+// recomputed from the ids, which keeps them exact (the .fvecs copy is single precision)
+static bool loadCached(const std::string& ids_path, DatasetView dataset, DatasetView queries, int K,
+                       std::vector<std::vector<std::pair<int, double>>>& results) {
+    std::vector<std::vector<int>> ids;
+    try {
+        ids = read_ivecs(ids_path);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    if (ids.size() != queries.size()) {
+        return false;
+    }
+
+    results.assign(queries.size(), {});
+    const std::size_t expected = std::min<std::size_t>(K, dataset.size());
+    for (std::size_t q = 0; q < ids.size(); ++q) {
+        if (ids[q].size() != expected) {
+            return false;
+        }
+        for (int id : ids[q]) {
+            if (id < 0 || static_cast<std::size_t>(id) >= dataset.size()) {
+                return false;
+            }
+            std::uint64_t distance = squaredEuclideanDistance(dataset.row(id), queries.row(q), dataset.dimension());
+            results[q].emplace_back(id, std::sqrt(static_cast<double>(distance)));
+        }
+    }
+    return true;
+}
+
+std::vector<std::vector<std::pair<int, double>>> cachedGroundTruth(const std::string& dataset_path,
+                                                                   const std::string& query_path,
+                                                                   DatasetView dataset, DatasetView queries, int K,
+                                                                   const std::string& cache_dir, bool* cache_hit) {
+    // Key: contents of both inputs, plus how many queries are answered and how many neighbors each
+    std::uint64_t key = hashFileContents(dataset_path);
+    MappedFile query_file = mapFile(query_path, MappingHint::Sequential);
+    key = fnv1a(query_file.bytes, query_file.size, key);
+
+    std::ostringstream name;
+    name << "gt_" << std::hex << std::setw(16) << std::setfill('0') << key << std::dec
+         << "_q" << queries.size() << "_k" << K;
+    const std::filesystem::path base = std::filesystem::path(cache_dir) / name.str();
+    const std::string ids_path = base.string() + ".ivecs";
+    const std::string distances_path = base.string() + ".fvecs";
+
+    std::vector<std::vector<std::pair<int, double>>> results;
+    if (std::filesystem::exists(ids_path) && loadCached(ids_path, dataset, queries, K, results)) {
+        if (cache_hit) {
+            *cache_hit = true;
+        }
+        return results;
+    }
+
+    results = exactKNearestNeighbors(dataset, queries, K);
+
+    std::vector<std::vector<int>> ids(results.size());
+    std::vector<std::vector<float>> distances(results.size());
+    for (std::size_t q = 0; q < results.size(); ++q) {
+        for (const auto& [id, distance] : results[q]) {
+            ids[q].push_back(id);
+            distances[q].push_back(static_cast<float>(distance));
+        }
+    }
+
+    // Written under temporary names and renamed, so an interrupted run never leaves a partial cache entry
+    std::filesystem::create_directories(cache_dir);
+    write_fvecs(distances_path + ".tmp", distances);
+    std::filesystem::rename(distances_path + ".tmp", distances_path);
+    write_ivecs(ids_path + ".tmp", ids);
+    std::filesystem::rename(ids_path + ".tmp", ids_path);
+
+    if (cache_hit) {
+        *cache_hit = false;
+    }
+    return results;
+}
@@ -0,0 +1,23 @@
+#ifndef PROJECT_K23_SEC_GROUND_TRUTH_H
+#define PROJECT_K23_SEC_GROUND_TRUTH_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dataset.h"
+
+// 64-bit FNV-1a hash of a file's contents
+std::uint64_t hashFileContents(const std::string& path);
+
+// Exact K nearest neighbors of every query, computed once and then reused from disk.
+// The result is stored in cache_dir as a standard pair of files, gt_<hash>_q<queries>_k<K>.ivecs (ids) and
+// .fvecs (distances), where <hash> combines the contents of the dataset and query files. Later runs with
+// unchanged inputs read the ids back instead of recomputing them. cache_hit reports which case happened.
+std::vector<std::vector<std::pair<int, double>>> cachedGroundTruth(const std::string& dataset_path,
+                                                                   const std::string& query_path,
+                                                                   DatasetView dataset, DatasetView queries, int K,
+                                                                   const std::string& cache_dir,
+                                                                   bool* cache_hit = nullptr);
+
+#endif //PROJECT_K23_SEC_GROUND_TRUTH_H
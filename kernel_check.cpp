@@ -0,0 +1,184 @@
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "distance_kernels.h"
+
+//
+// Checks that every distance kernel the running CPU can execute returns exactly what the scalar kernel returns.
+// Run with `make check`; exits with 1 and names the kernel, length and input on the first kind of mismatch.
+//
+
+namespace {
+
+// SIMD kernels flush their 32-bit lanes every 4096 dimensions; lengths around each flush are checked one by one
+constexpr std::size_t kFlushBlock = 4096;
+
+struct Input {
+    const char* name;
+    std::vector<unsigned char> query;
+    std::vector<std::vector<unsigned char>> rows; // four rows
+};
+
+std::vector<std::size_t> testLengths() {
+    std::vector<std::size_t> lengths;
+    for (std::size_t n = 0; n <= 300; ++n) {
+        lengths.push_back(n);
+    }
+    lengths.push_back(784);
+    lengths.push_back(960);
+    for (std::size_t block = 1; block <= 3; ++block) {
+        for (std::size_t n = block * kFlushBlock - 65; n <= block * kFlushBlock + 65; ++n) {
+            lengths.push_back(n);
+        }
+    }
+    return lengths;
+}
+
+std::vector<Input> testInputs(std::size_t max_length) {
+    std::mt19937 generator(23);
+    std::uniform_int_distribution<int> byte(0, 255);
+    // One spare byte, so every kernel also runs on rows that start off their natural alignment
+    const std::size_t size = max_length + 1;
+
+    std::vector<Input> inputs;
+    Input random{"random", std::vector<unsigned char>(size), {}};
+    for (unsigned char& value : random.query) {
+        value = static_cast<unsigned char>(byte(generator));
+    }
+    for (int r = 0; r < 4; ++r) {
+        std::vector<unsigned char> row(size);
+        for (unsigned char& value : row) {
+            value = static_cast<unsigned char>(byte(generator));
+        }
+        random.rows.push_back(row);
+    }
+    inputs.push_back(random);
+
+    // Largest squared differences: 255 against 0 in every dimension
+    inputs.push_back({"255 vs 0", std::vector<unsigned char>(size, 255),
+                      std::vector<std::vector<unsigned char>>(4, std::vector<unsigned char>(size, 0))});
+    // Largest products: 255 times 255 in every dimension
+    inputs.push_back({"all 255", std::vector<unsigned char>(size, 255),
+                      std::vector<std::vector<unsigned char>>(4, std::vector<unsigned char>(size, 255))});
+    return inputs;
+}
+
+int failures = 0;
+
+void report(const std::string& kernel, const Input& input, std::size_t n, std::size_t offset,
+            std::uint64_t expected, std::uint64_t actual) {
+    if (++failures <= 20) {
+        std::cerr << kernel << ": n=" << n << " offset=" << offset << " input=" << input.name
+                  << " expected " << expected << ", got " << actual << std::endl;
+    }
+}
+
+// A bounded result must be exact when it is <= bound, and only has to exceed bound otherwise
+void checkBounded(const std::string& kernel, const Input& input, std::size_t n, std::size_t offset,
+                  std::uint64_t exact, std::uint64_t bound, std::uint64_t actual) {
+    if (exact <= bound ? actual != exact : actual <= bound) {
+        report(kernel + " (bound " + std::to_string(bound) + ")", input, n, offset, exact, actual);
+    }
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::size_t> lengths = testLengths();
+    const std::vector<Input> inputs = testInputs(lengths.back());
+
+    const auto single = availableSquaredL2Kernels();
+    const auto x4 = availableSquaredL2x4Kernels();
+    const auto dot = availableDotU8x4Kernels();
+
+    std::cout << "Checking kernels:";
+    for (const auto& kernel : single) {
+        std::cout << " " << kernel.first;
+    }
+    std::cout << " | x4:";
+    for (const auto& kernel : x4) {
+        std::cout << " " << kernel.first;
+    }
+    std::cout << " | dot x4:";
+    for (const auto& kernel : dot) {
+        std::cout << " " << kernel.first;
+    }
+    std::cout << std::endl;
+
+    for (const Input& input : inputs) {
+        for (std::size_t offset = 0; offset <= 1; ++offset) {
+            for (std::size_t n : lengths) {
+                const unsigned char* query = input.query.data() + offset;
+                const unsigned char* rows[4];
+                for (int r = 0; r < 4; ++r) {
+                    rows[r] = input.rows[r].data() + offset;
+                }
+
+                std::uint64_t expected[4];
+                std::uint64_t expected_dot[4];
+                for (int r = 0; r < 4; ++r) {
+                    expected[r] = squaredL2Scalar(query, rows[r], n);
+                }
+                dotU8x4Scalar(query, rows, n, expected_dot);
+
+                for (const auto& kernel : single) {
+                    for (int r = 0; r < 4; ++r) {
+                        const std::uint64_t actual = kernel.second(query, rows[r], n);
+                        if (actual != expected[r]) {
+                            report(kernel.first, input, n, offset, expected[r], actual);
+                        }
+                    }
+                }
+
+                std::uint64_t out[4];
+                for (const auto& kernel : x4) {
+                    kernel.second(query, rows, n, out);
+                    for (int r = 0; r < 4; ++r) {
+                        if (out[r] != expected[r]) {
+                            report(std::string("x4 ") + kernel.first, input, n, offset, expected[r], out[r]);
+                        }
+                    }
+                }
+                for (const auto& kernel : dot) {
+                    kernel.second(query, rows, n, out);
+                    for (int r = 0; r < 4; ++r) {
+                        if (out[r] != expected_dot[r]) {
+                            report(std::string("dot x4 ") + kernel.first, input, n, offset, expected_dot[r], out[r]);
+                        }
+                    }
+                }
+
+                // Dispatched entry points, including the bounded ones, with bounds on both sides of the result
+                dotU8x4(query, rows, n, out);
+                for (int r = 0; r < 4; ++r) {
+                    if (out[r] != expected_dot[r]) {
+                        report("dotU8x4", input, n, offset, expected_dot[r], out[r]);
+                    }
+                }
+                const std::uint64_t bounds[] = {0, expected[0] / 2, expected[0] > 0 ? expected[0] - 1 : 0, expected[0],
+                                                expected[0] + 1, std::numeric_limits<std::uint64_t>::max()};
+                for (std::uint64_t bound : bounds) {
+                    for (int r = 0; r < 4; ++r) {
+                        checkBounded("squaredL2Bounded", input, n, offset, expected[r], bound,
+                                     squaredL2Bounded(query, rows[r], n, bound));
+                    }
+                    squaredL2x4Bounded(query, rows, n, bound, out);
+                    for (int r = 0; r < 4; ++r) {
+                        checkBounded("squaredL2x4Bounded", input, n, offset, expected[r], bound, out[r]);
+                    }
+                }
+            }
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "All kernels agree on " << lengths.size() << " lengths, " << inputs.size()
+              << " inputs and 2 alignments." << std::endl;
+    return 0;
+}
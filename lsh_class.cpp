@@ -5,141 +5,524 @@
 #include <random>
 #include <cmath>
 #include <limits>
-#include <set>
 #include <algorithm>
+#include <cstring>
 
 #include <queue>
 #include "lsh_class.h"
 #include "global_functions.h"
+#include "projection.h"
 
 
 // LSH Constructor
-LSH::LSH(std::vector<std::vector<unsigned char>> dataset,int k, int L, int N, double R)
-        : dataset(std::move(dataset)),
-          k(k), L(L),
+LSH::LSH(DatasetView dataset,int k, int L, int N, double R, int num_threads, unsigned int seed,
+         double bucket_width, HashArithmetic arithmetic, double load_factor, int split_threshold)
+        : k(k), L(L),
+          load_factor(load_factor),
           N(N), R(R),
-          hash_tables(L, std::vector<std::vector<std::pair<int, int>>>(num_buckets)),
-          hash_functions(L)
+          dataset(dataset),
+          num_dimensions(static_cast<int>(dataset.dimension())),
+          num_threads(num_threads),
+          hash_tables(L),
+          base_size(dataset.size()),
+          delta(L),
+          removed(dataset.size(), 0),
+          arithmetic(arithmetic)
 {
-
-    // Δημιουργία των hash functions για κάθε table
-    for(int i = 0; i < L; ++i) {
-        hash_functions[i] = createHashFunctions(k, num_dimensions);
+    if (this->dataset.empty() || num_dimensions == 0) {
+        throw std::invalid_argument("Dataset is empty.");
+    }
+    if (!(load_factor > 0)) {
+        throw std::invalid_argument("Load factor must be positive.");
+    }
+    num_buckets = bucketsFor(base_size);
+    if (split_threshold == 0) {
+        this->split_threshold = std::numeric_limits<std::size_t>::max();
+    } else if (split_threshold < 0) {
+        // Runs up to a few times the average bucket are normal; longer ones come from skew
+        this->split_threshold = std::max<std::size_t>(64, static_cast<std::size_t>(16 * load_factor));
+    } else {
+        this->split_threshold = static_cast<std::size_t>(split_threshold);
     }
 
     // Δημιουργία τυχαίων τιμών 'ri' για τα hash functions
     ri_values.resize(k);
-    std::random_device rd;
-    std::default_random_engine generator(rd());
+    std::default_random_engine generator(seed);
     std::uniform_int_distribution<int> dist(0, std::numeric_limits<int>::max()); // Range for int
     for (int i = 0; i < k; ++i) {
         ri_values[i] = dist(generator);
     }
 
     // Generate 'w' randomly in the range [400, 500]
-
+    // (before the hash functions, whose offsets t are drawn from [0, w))
     std::uniform_real_distribution<double> w_distribution(400, 500);
     w = w_distribution(generator);
+    if (bucket_width > 0) {
+        w = bucket_width;
+    }
+
+    // Δημιουργία των hash functions για κάθε table
+    createHashFunctions(generator);
+    quantized_projections = quantizeMatrix(projections.data(), functionCount(), num_dimensions);
+
     buildIndex();
 }
 
-// LSH Destructor
+void LSH::buildIndex() {
+    const std::size_t n = dataset.size();
+
+    // Pass 1: IDs of every point for every table. Threads take blocks of points, and each block is
+    // projected with one matrix-matrix product. Every point's IDs have their own slots, so no locking.
+    const std::size_t block_size = 256;
+    const std::size_t num_functions = functionCount();
+    std::vector<int> point_ids(n * L);
+    std::vector<int> point_splits(n * L);
+
+    parallelFor(n, block_size, num_threads, [&](std::size_t begin, std::size_t end) {
+        std::vector<float> block_projections((end - begin) * num_functions);
+        project(dataset, begin, end, block_projections.data(), arithmetic);
+
+        for (std::size_t i = begin; i < end; ++i) {
+            const float* point_projections = block_projections.data() + (i - begin) * num_functions;
+            for (int table_index = 0; table_index < L; ++table_index) {
+                point_ids[i * L + table_index] = static_cast<int>(idFromProjections(point_projections, table_index));
+                point_splits[i * L + table_index] = splitFromProjections(point_projections, table_index).own;
+            }
+        }
+    });
+
+    // Pass 2: counting sort of the entries into one compact array per table. Tables are independent,
+    // so each one is assembled by a single thread. Buckets are sorted by (ID, index), which makes the
+    // layout the same whatever the thread count.
+    parallelFor(static_cast<std::size_t>(L), 1, num_threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t table_index = begin; table_index < end; ++table_index) {
+            buildTable(static_cast<int>(table_index), point_ids, point_splits);
+        }
+    });
+}
+
+void LSH::buildTable(int table_index, const std::vector<int>& point_ids, const std::vector<int>& point_splits) {
+    const std::size_t n = dataset.size();
+    std::vector<BucketEntry> entries(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        entries[i] = {point_ids[i * L + table_index], point_splits[i * L + table_index], static_cast<int>(i)};
+    }
+    hash_tables[table_index] = layoutTable(entries, num_buckets);
+}
+
+int LSH::bucketsFor(std::size_t points) const {
+    return static_cast<int>(std::max(1.0, std::ceil(static_cast<double>(points) / load_factor)));
+}
+
+LSH::HashTable LSH::layoutTable(const std::vector<BucketEntry>& entries, int bucket_count) {
+    HashTable table;
+    table.offsets.assign(bucket_count + 1, 0);
+    for (const BucketEntry& entry : entries) {
+        int hash_value = entry.id_value % bucket_count; // id_value mod TableSize
+        table.offsets[hash_value + 1]++;
+    }
+    for (int b = 0; b < bucket_count; ++b) {
+        table.offsets[b + 1] += table.offsets[b];
+    }
+
+    table.entries.resize(entries.size());
+    std::vector<int> fill(table.offsets.begin(), table.offsets.end() - 1);
+    for (const BucketEntry& entry : entries) {
+        table.entries[fill[entry.id_value % bucket_count]++] = entry;
+    }
+
+    // Within a bucket, order by ID value, then split hash (ties keep index order), so that both the
+    // matching runs and their split parts are contiguous
+    for (int b = 0; b < bucket_count; ++b) {
+        std::sort(table.entries.begin() + table.offsets[b], table.entries.begin() + table.offsets[b + 1],
+                  [](const BucketEntry& a, const BucketEntry& e) {
+                      if (a.id_value != e.id_value) {
+                          return a.id_value < e.id_value;
+                      }
+                      return a.split_hash != e.split_hash ? a.split_hash < e.split_hash : a.index < e.index;
+                  });
+    }
+    return table;
+}
+
 LSH::~LSH() {
-    for (auto& table_functions : hash_functions) {
-        for (auto& hash_function : table_functions) {
-            hash_function.first.clear(); // Clear the vector within each pair
+    if (compaction_thread.joinable()) {
+        compaction_thread.join();
+    }
+}
+
+int LSH::insert(const std::vector<unsigned char>& point) {
+    if (point.size() != static_cast<std::size_t>(num_dimensions)) {
+        throw std::invalid_argument("Point dimension does not match the dataset.");
+    }
+    // Hash before taking the lock: only the bookkeeping below blocks queries
+    std::vector<std::pair<int, int64_t>> sequence;
+    std::vector<SplitSlots> split_slots;
+    probeSequence(point.data(), 0, sequence, split_slots);
+
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    if (num_inserted == inserted_points.size()) {
+        Dataset grown(std::max<std::size_t>(64, 2 * num_inserted), num_dimensions);
+        if (num_inserted > 0) {
+            std::memcpy(grown.mutableRow(0), inserted_points.row(0), num_inserted * inserted_points.stride());
         }
-        table_functions.clear(); // Clear the table's vector of hash functions
+        inserted_points = std::move(grown);
+    }
+    std::memcpy(inserted_points.mutableRow(num_inserted), point.data(), point.size());
+    const int index = static_cast<int>(base_size + num_inserted++);
+    removed.push_back(0);
+
+    for (const auto& [table_index, id_value] : sequence) {
+        delta[table_index].emplace(static_cast<int>(id_value), index);
+        delta_log.push_back({static_cast<int>(id_value), split_slots[table_index].own, index});
     }
-    hash_functions.clear(); // Clear the vector of hash function tables
+    ++pending_updates;
+    maybeStartCompaction();
+    return index;
 }
 
-void LSH::buildIndex() {
-    // Resize the hash tables to have num_buckets buckets
-    for (auto& table : hash_tables) {
-        table.resize(num_buckets);
+bool LSH::remove(int index) {
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    if (index < 0 || static_cast<std::size_t>(index) >= removed.size() || removed[index]) {
+        return false;
     }
+    removed[index] = 1;
+    ++pending_updates;
+    maybeStartCompaction();
+    return true;
+}
 
-    for (int i = 0; i < dataset.size(); ++i) {
-        for (int table_index = 0; table_index < L; ++table_index) {
-            int64_t id_value = computeID(dataset[i], table_index);
-            //std::cout << "id_value: " << id_value << std::endl;
-            int64_t hash_value = id_value % num_buckets; // id_value mod TableSize
-            //std::cout << "hash_value: " << hash_value << std::endl;
-            hash_tables[table_index][hash_value].emplace_back(i, id_value);
+void LSH::maybeStartCompaction() {
+    // Compact once the updates amount to an eighth of the index, so the delta maps stay small
+    const std::size_t threshold = std::max<std::size_t>(1024, (base_size + num_inserted) / 8);
+    if (pending_updates < threshold || compaction_running.exchange(true)) {
+        return;
+    }
+    if (compaction_thread.joinable()) {
+        compaction_thread.join(); // The previous compaction has already finished
+    }
+    compaction_thread = std::thread([this] {
+        try {
+            compact();
+        } catch (...) {
+            // The index stays valid, just uncompacted; a later update will try again
+        }
+        compaction_running = false;
+    });
+}
+
+void LSH::compact() {
+    std::lock_guard<std::mutex> guard(compaction_mutex);
+
+    // Snapshot the updates so far. Later ones stay in the delta maps; later removals stay
+    // flagged in `removed`, so results are right either way.
+    std::vector<BucketEntry> logged;
+    std::vector<unsigned char> removed_snapshot;
+    std::size_t compacted_updates;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex);
+        logged = delta_log;
+        removed_snapshot = removed;
+        compacted_updates = pending_updates;
+    }
+
+    // hash_tables is only replaced here, under compaction_mutex, so it can be read without index_mutex
+    std::vector<HashTable> tables(L);
+    parallelFor(static_cast<std::size_t>(L), 1, num_threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t table_index = begin; table_index < end; ++table_index) {
+            std::vector<BucketEntry> entries;
+            entries.reserve(hash_tables[table_index].entries.size() + logged.size() / L);
+            for (const BucketEntry& entry : hash_tables[table_index].entries) {
+                if (!removed_snapshot[entry.index]) {
+                    entries.push_back(entry);
+                }
+            }
+            for (std::size_t j = table_index; j < logged.size(); j += L) {
+                if (!removed_snapshot[logged[j].index]) {
+                    entries.push_back(logged[j]);
+                }
+            }
+            // The table is resized to the number of live points
+            tables[table_index] = layoutTable(entries, bucketsFor(entries.size()));
         }
+    });
+
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    hash_tables.swap(tables);
+    num_buckets = static_cast<int>(hash_tables[0].offsets.size()) - 1;
+    // Keep only the delta entries logged after the snapshot
+    delta_log.erase(delta_log.begin(), delta_log.begin() + static_cast<std::ptrdiff_t>(logged.size()));
+    for (auto& table_delta : delta) {
+        table_delta.clear();
+    }
+    for (std::size_t j = 0; j < delta_log.size(); ++j) {
+        delta[j % L].emplace(delta_log[j].id_value, delta_log[j].index);
     }
+    pending_updates -= compacted_updates;
 }
 
+DatasetView LSH::insertedView() const {
+    return inserted_points.view().head(num_inserted);
+}
 
-// Δημιουργία μιας λίστας από nf hash_functions για το LSH χρησιμοποιώντας κανονικές και ομοιόμορφες κατανομές
-std::vector<std::pair<std::vector<double>, double>> LSH::createHashFunctions(int nf, int nd) const {
-    // Αρχικοποίηση random number generator
-    std::random_device rd;
-    std::default_random_engine generator(rd());
-    std::normal_distribution<double> distribution(0.0, 1.0);
-    std::uniform_real_distribution<double> uniform_dist(0, w);
+std::vector<unsigned char> LSH::point(int index) const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    if (index < 0 || static_cast<std::size_t>(index) >= base_size + num_inserted) {
+        throw std::out_of_range("Unknown point index.");
+    }
+    const unsigned char* row = static_cast<std::size_t>(index) < base_size ? dataset.row(index)
+                                                                            : inserted_points.row(index - base_size);
+    return std::vector<unsigned char>(row, row + num_dimensions);
+}
 
+void LSH::splitInserted(std::vector<int>& candidates, std::vector<int>& inserted_ids) const {
+    inserted_ids.clear();
+    std::size_t kept = 0;
+    for (int index : candidates) {
+        if (static_cast<std::size_t>(index) < base_size) {
+            candidates[kept++] = index;
+        } else {
+            inserted_ids.push_back(static_cast<int>(index - base_size));
+        }
+    }
+    candidates.resize(kept);
+}
 
+void LSH::scanAll(const unsigned char* query, std::vector<int>& candidates, TopKHeap& nearest) const {
+    thread_local std::vector<int> inserted_ids;
+    thread_local std::vector<std::uint64_t> distances;
+    splitInserted(candidates, inserted_ids);
+    scanCandidates(dataset, query, candidates, nearest);
+    if (!inserted_ids.empty()) {
+        distancesToMany(insertedView(), query, inserted_ids, distances, nearest.bound());
+        for (std::size_t i = 0; i < inserted_ids.size(); ++i) {
+            nearest.push(distances[i], static_cast<int>(inserted_ids[i] + base_size));
+        }
+    }
+}
 
-    std::vector<std::pair<std::vector<double>, double>> local_hash_functions;
-    local_hash_functions.reserve(nf);
-    // Δημιουργήσαμε nf hash_functions που παράγουν και αποθηκεύουν v μεγέθους nd και t στο [0, w)
-    for (int i = 0; i < nf; ++i) {
-        std::vector<double> v(nd);
-        for (int j = 0; j < nd; ++j) {
-            v[j] = distribution(generator);
+void LSH::appendMatches(int table_index, int64_t id_value, SplitSlots split_slots, std::vector<int>& candidates,
+                        VisitedSet& visited) const {
+    const HashTable& table = hash_tables[table_index];
+    const int bucket_count = static_cast<int>(table.offsets.size()) - 1;
+    const int hash_value = static_cast<int>(id_value % bucket_count);
+    auto first = table.entries.begin() + table.offsets[hash_value];
+    auto last = table.entries.begin() + table.offsets[hash_value + 1];
+
+    // Only points whose ID matches the query's ID are candidates
+    auto run = std::equal_range(first, last, BucketEntry{static_cast<int>(id_value), 0, 0},
+                                [](const BucketEntry& a, const BucketEntry& e) { return a.id_value < e.id_value; });
+    auto take = [&](auto begin, auto end) {
+        for (auto it = begin; it != end; ++it) {
+            if (!removed[it->index] && visited.insert(it->index)) {
+                candidates.push_back(it->index);
+            }
+        }
+    };
+    if (static_cast<std::size_t>(run.second - run.first) <= split_threshold) {
+        take(run.first, run.second);
+    } else {
+        // Oversized run: only the parts in the query's split slot and the neighbouring one closer to it
+        auto by_split = [](const BucketEntry& a, const BucketEntry& e) { return a.split_hash < e.split_hash; };
+        for (int slot : {split_slots.own, split_slots.nearest}) {
+            auto part = std::equal_range(run.first, run.second, BucketEntry{0, slot, 0}, by_split);
+            take(part.first, part.second);
         }
-        double t = uniform_dist(generator);
-        local_hash_functions.emplace_back(v, t);
     }
 
-    return local_hash_functions;
+    // Points inserted since the last compaction
+    auto inserted = delta[table_index].equal_range(static_cast<int>(id_value));
+    for (auto it = inserted.first; it != inserted.second; ++it) {
+        if (!removed[it->second] && visited.insert(it->second)) {
+            candidates.push_back(it->second);
+        }
+    }
 }
 
-int64_t LSH::computeID(const std::vector<unsigned char>& data_point, int table_index) {
-    if (table_index < 0 || table_index >= L) {
-        throw std::out_of_range("Invalid table_index");
+
+// Δημιουργία L*k hash_functions για το LSH χρησιμοποιώντας κανονικές και ομοιόμορφες κατανομές
+void LSH::createHashFunctions(std::default_random_engine& generator) {
+    std::normal_distribution<double> distribution(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform_dist(0, w);
+
+    const std::size_t num_functions = static_cast<std::size_t>(L) * k;
+    projections.resize(num_functions * num_dimensions);
+    offsets.resize(num_functions);
+    // Κάθε hash function έχει v μεγέθους num_dimensions και t στο [0, w)
+    for (std::size_t f = 0; f < num_functions; ++f) {
+        for (int j = 0; j < num_dimensions; ++j) {
+            projections[f * num_dimensions + j] = static_cast<float>(distribution(generator));
+        }
+        offsets[f] = uniform_dist(generator);
     }
-    if (data_point.size() != num_dimensions) {
-        throw std::invalid_argument("Invalid data_point dimensions");
+
+    // One split hash function per table, drawn last so the other functions stay the same for a seed
+    projections.resize(functionCount() * num_dimensions);
+    offsets.resize(functionCount());
+    for (std::size_t f = num_functions; f < functionCount(); ++f) {
+        for (int j = 0; j < num_dimensions; ++j) {
+            projections[f * num_dimensions + j] = static_cast<float>(distribution(generator));
+        }
+        offsets[f] = uniform_dist(generator);
     }
+}
 
-    auto& table_functions = hash_functions[table_index];
+namespace {
+const int64_t M = (1LL << 30) - 5; // Modulus of the ID values
+//const int64_t M = (1LL << 32) - 5; // This simply wont work, id_value!= query_id_value always with this M
+//const int64_t M = 1000000003; // Define M as a large prime
+const int64_t hash_shift = 100000; // Added to hi to ensure it's positive
+}
 
-    if (table_functions.size() != k) {
-        throw std::runtime_error("Invalid number of hash functions for the table.");
+void LSH::project(DatasetView points, std::size_t begin, std::size_t end, float* out, HashArithmetic with) const {
+    if (with == HashArithmetic::Quantized) {
+        projectPointsQuantized(quantized_projections, points, begin, end, out);
+    } else {
+        projectPoints(projections.data(), functionCount(), num_dimensions, points, begin, end, out);
+    }
+}
+
+std::size_t LSH::hashDisagreements(DatasetView points) const {
+    const std::size_t block_size = 256;
+    const std::size_t num_functions = functionCount();
+    std::vector<float> float_projections(block_size * num_functions);
+    std::vector<float> quantized(block_size * num_functions);
+    std::size_t disagreements = 0;
+    for (std::size_t begin = 0; begin < points.size(); begin += block_size) {
+        std::size_t end = std::min(points.size(), begin + block_size);
+        project(points, begin, end, float_projections.data(), HashArithmetic::Float);
+        project(points, begin, end, quantized.data(), HashArithmetic::Quantized);
+        for (std::size_t i = 0; i < end - begin; ++i) {
+            for (int table_index = 0; table_index < L; ++table_index) {
+                if (idFromProjections(float_projections.data() + i * num_functions, table_index) !=
+                    idFromProjections(quantized.data() + i * num_functions, table_index)) {
+                    ++disagreements;
+                    break;
+                }
+            }
+        }
     }
+    return disagreements;
+}
 
-    //const int64_t M = (1LL << 32) - 5; // This simply wont work, id_value!= query_id_value always with this M
-    //const int64_t M = 1000000003; // Define M as a large prime
-    const int64_t M = (1LL << 30) - 5;
-    uint64_t id_value = 0;
+int64_t LSH::idFromProjections(const float* point_projections, int table_index) const {
+    int64_t id_value = 0;
 
     for (int i = 0; i < k; ++i) {
-        auto& [v, t] = table_functions[i];
-        double dot_product = 0.0;
-        for (int j = 0; j < num_dimensions; ++j) {
-            dot_product += v[j] * data_point[j];
-        }
-        int hi = static_cast<int>(std::floor((dot_product + t) / w));
-        hi += 100000; // Ensure it's positive
-        uint64_t ri_hi_mod_M = (ri_values[i] * hi) % M;
+        const std::size_t f = static_cast<std::size_t>(table_index) * k + i;
+        int64_t hi = static_cast<int64_t>(std::floor((point_projections[f] + offsets[f]) / w));
+        hi += hash_shift; // Ensure it's positive
+        // 64-bit product: r_i can be as large as INT_MAX
+        int64_t ri_hi_mod_M = (static_cast<int64_t>(ri_values[i]) * hi) % M;
         id_value = (id_value + ri_hi_mod_M) % M;
-        //std::cout << "id_value: " << id_value << std::endl;
     }
     // id_value = [(r1h1(p) + r2h2(p) + · · · + rkhk (p)) mod M]
     return id_value;
 }
 
+LSH::SplitSlots LSH::splitFromProjections(const float* point_projections, int table_index) const {
+    const std::size_t f = static_cast<std::size_t>(L) * k + table_index;
+    const double position = (point_projections[f] + offsets[f]) / w;
+    const double slot = std::floor(position);
+    const int own = static_cast<int>(slot);
+    return {own, position - slot < 0.5 ? own - 1 : own + 1};
+}
+
+int64_t LSH::idFromHashes(const int64_t* hashes) const {
+    int64_t id_value = 0;
+    for (int i = 0; i < k; ++i) {
+        // A perturbed slot can sit one below hi = 0; keep the term non-negative
+        int64_t ri_hi_mod_M = ((static_cast<int64_t>(ri_values[i]) * hashes[i]) % M + M) % M;
+        id_value = (id_value + ri_hi_mod_M) % M;
+    }
+    return id_value;
+}
+
+void LSH::probeSequence(const unsigned char* query_point, int probes,
+                        std::vector<std::pair<int, int64_t>>& sequence, std::vector<SplitSlots>& split_slots) const {
+    std::vector<float> point_projections(functionCount());
+    DatasetView query(query_point, 1, num_dimensions, num_dimensions);
+    project(query, 0, 1, point_projections.data(), arithmetic);
+
+    // The query's own bucket in every table comes first
+    sequence.clear();
+    split_slots.resize(L);
+    for (int table_index = 0; table_index < L; ++table_index) {
+        sequence.emplace_back(table_index, idFromProjections(point_projections.data(), table_index));
+        split_slots[table_index] = splitFromProjections(point_projections.data(), table_index);
+    }
+    if (probes <= 0) {
+        return;
+    }
+
+    // Perturbation 2i moves function i one slot down and 2i + 1 one slot up. Its score is the squared
+    // distance (in slot widths) from the query's projection to that neighbouring slot.
+    std::vector<std::vector<int64_t>> table_hashes(L, std::vector<int64_t>(k));
+    std::vector<PerturbationSequence> perturbations;
+    perturbations.reserve(L);
+    std::vector<double> scores(2 * static_cast<std::size_t>(k));
+    for (int table_index = 0; table_index < L; ++table_index) {
+        for (int i = 0; i < k; ++i) {
+            const std::size_t f = static_cast<std::size_t>(table_index) * k + i;
+            double position = (point_projections[f] + offsets[f]) / w;
+            double slot = std::floor(position);
+            double fraction = position - slot;
+            table_hashes[table_index][i] = static_cast<int64_t>(slot) + hash_shift;
+            scores[2 * i] = fraction * fraction;
+            scores[2 * i + 1] = (1 - fraction) * (1 - fraction);
+        }
+        perturbations.emplace_back(scores);
+    }
+
+    // Merge the tables' sequences, always taking the lowest-scoring perturbation next
+    std::vector<int> subset;
+    std::vector<int64_t> hashes(k);
+    std::vector<int> moved(k);
+    int produced = 0;
+    while (produced < probes) {
+        int best_table = -1;
+        double best_score = std::numeric_limits<double>::infinity();
+        for (int table_index = 0; table_index < L; ++table_index) {
+            double score = perturbations[table_index].peekScore();
+            if (score < best_score) {
+                best_score = score;
+                best_table = table_index;
+            }
+        }
+        if (best_table < 0) {
+            break; // Every perturbation of every table has been probed
+        }
+        perturbations[best_table].next(subset);
+
+        // Moving one function both down and up is not a probe
+        std::fill(moved.begin(), moved.end(), 0);
+        bool valid = true;
+        for (int perturbation : subset) {
+            valid = valid && moved[perturbation / 2]++ == 0;
+        }
+        if (!valid) {
+            continue;
+        }
+
+        hashes = table_hashes[best_table];
+        for (int perturbation : subset) {
+            hashes[perturbation / 2] += perturbation % 2 == 0 ? -1 : 1;
+        }
+        sequence.emplace_back(best_table, idFromHashes(hashes.data()));
+        ++produced;
+    }
+}
+
 // Create function to print hash tables
 void LSH::printHashTables() {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
     for (int table_index = 0; table_index < L; ++table_index) {
         std::cout << "Table " << table_index << ":" << std::endl;
-        for (int bucket_index = 0; bucket_index < num_buckets; ++bucket_index) {
+        const HashTable& table = hash_tables[table_index];
+        for (int bucket_index = 0; bucket_index + 1 < static_cast<int>(table.offsets.size()); ++bucket_index) {
             std::cout << "Bucket " << bucket_index << ": ";
-            for (const auto& [index, id_value] : hash_tables[table_index][bucket_index]) {
-                std::cout << index << " ";
+            for (int e = table.offsets[bucket_index]; e < table.offsets[bucket_index + 1]; ++e) {
+                std::cout << table.entries[e].index << " ";
             }
             std::cout << std::endl;
         }
@@ -148,67 +531,183 @@ void LSH::printHashTables() {
 }
 
 
-std::vector<std::pair<int, double>> LSH::queryNNearestNeighbors(const std::vector<unsigned char>& query_point, int K) {
-    std::priority_queue<std::pair<double, int>> nearest_neighbors_queue;
+void LSH::printBucketStatistics(std::ostream& out) const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
     for (int table_index = 0; table_index < L; ++table_index) {
-        int64_t query_id_value = computeID(query_point, table_index); // Compute the ID for the query_point
-        int64_t hash_value = query_id_value % num_buckets;
-
-        for (const auto& [candidate_index, id_value] : hash_tables[table_index][hash_value]) {
-            // Only compute the distance if the ID of the data point matches the ID of the query_point
-            if (id_value == query_id_value) {
-                //std::cout << "id_value: " << id_value << std::endl;
-                double distance = euclideanDistance(dataset[candidate_index], query_point);
-                nearest_neighbors_queue.emplace(distance, candidate_index);
+        const HashTable& table = hash_tables[table_index];
+        const int bucket_count = static_cast<int>(table.offsets.size()) - 1;
+
+        // histogram[c] counts buckets of size 0 (c = 0) or [2^(c-1), 2^c) (c >= 1)
+        std::vector<std::size_t> histogram;
+        std::vector<int> sizes(bucket_count);
+        int empty = 0;
+        std::size_t longest_run = 0;
+        std::size_t split_runs = 0;
+        std::size_t split_entries = 0;
+        for (int b = 0; b < bucket_count; ++b) {
+            const int size = table.offsets[b + 1] - table.offsets[b];
+            sizes[b] = size;
+            empty += size == 0;
+            std::size_t size_class = 0;
+            while ((std::size_t{1} << size_class) <= static_cast<std::size_t>(size)) {
+                ++size_class;
+            }
+            if (histogram.size() <= size_class) {
+                histogram.resize(size_class + 1, 0);
+            }
+            ++histogram[size_class];
+
+            for (int e = table.offsets[b]; e < table.offsets[b + 1];) {
+                int run_end = e;
+                while (run_end < table.offsets[b + 1] && table.entries[run_end].id_value == table.entries[e].id_value) {
+                    ++run_end;
+                }
+                const std::size_t run = static_cast<std::size_t>(run_end - e);
+                longest_run = std::max(longest_run, run);
+                if (run > split_threshold) {
+                    ++split_runs;
+                    split_entries += run;
+                }
+                e = run_end;
+            }
+        }
+        std::sort(sizes.begin(), sizes.end());
+        const std::size_t entries = table.entries.size();
+        const std::size_t non_empty = static_cast<std::size_t>(bucket_count - empty);
+
+        out << "Table " << table_index << ": " << bucket_count << " buckets, " << entries << " entries, "
+            << empty << " empty, mean non-empty size " << (non_empty ? static_cast<double>(entries) / non_empty : 0.0)
+            << ", p99 " << sizes[std::min<std::size_t>(sizes.size() - 1, sizes.size() * 99 / 100)]
+            << ", max " << sizes.back() << std::endl;
+        out << "  longest ID run " << longest_run << ", ";
+        if (split_threshold == std::numeric_limits<std::size_t>::max()) {
+            out << "run splitting off" << std::endl;
+        } else {
+            out << split_runs << " runs over " << split_threshold << " split (" << split_entries << " entries)"
+                << std::endl;
+        }
+        out << "  sizes:";
+        for (std::size_t c = 0; c < histogram.size(); ++c) {
+            if (histogram[c] == 0) {
+                continue;
+            }
+            if (c == 0) {
+                out << " [0]=" << histogram[c];
+            } else {
+                out << " [" << (std::size_t{1} << (c - 1)) << "," << (std::size_t{1} << c) << ")=" << histogram[c];
             }
         }
+        out << std::endl;
     }
+}
 
-    std::vector<std::pair<int, double>> nearest_neighbors;
-    while (!nearest_neighbors_queue.empty() && nearest_neighbors.size() < K) {
-        nearest_neighbors.emplace_back(nearest_neighbors_queue.top().second, nearest_neighbors_queue.top().first);
-        nearest_neighbors_queue.pop();
+std::vector<std::pair<int, double>> LSH::queryNNearestNeighbors(const unsigned char* query_point, int K,
+                                                                int max_candidates, int probes) {
+    thread_local std::vector<std::pair<int, int64_t>> sequence;
+    thread_local std::vector<SplitSlots> split_slots;
+    // The buckets to visit, from a single projection pass
+    probeSequence(query_point, probes, sequence, split_slots);
+
+    // Scratch reused by every query on this thread
+    thread_local VisitedSet visited;
+    thread_local std::vector<int> candidates;
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    visited.clear(base_size + num_inserted);
+
+    TopKHeap nearest_neighbors(K);
+    std::size_t remaining = max_candidates > 0 ? static_cast<std::size_t>(max_candidates)
+                                               : std::numeric_limits<std::size_t>::max();
+    for (std::size_t p = 0; p < sequence.size() && remaining > 0; ++p) {
+        // Only compute the distance if the ID of the data point matches the probed ID,
+        // and only the first time the point turns up
+        candidates.clear();
+        appendMatches(sequence[p].first, sequence[p].second, split_slots[sequence[p].first], candidates, visited);
+        if (candidates.size() > remaining) {
+            candidates.resize(remaining);
+        }
+        remaining -= candidates.size();
+        // Once K neighbors are known, farther candidates are abandoned part-way through
+        scanAll(query_point, candidates, nearest_neighbors);
     }
 
-    std::reverse(nearest_neighbors.begin(), nearest_neighbors.end());
-
-    return nearest_neighbors;
+    return nearest_neighbors.sortedResults();
 }
 
 // Overload 1: Doesn't take radius, uses the class's private member R
-std::vector<int> LSH::rangeSearch(const std::vector<unsigned char>& query_point) {
+std::vector<int> LSH::rangeSearch(const unsigned char* query_point) {
     return rangeSearch(query_point, R); // Call the second overload using the class's private member R
 }
 
 // Overload 2: Takes a radius and uses that
-std::vector<int> LSH::rangeSearch(const std::vector<unsigned char>& query_point, double radius) {
-    std::set<int> candidates_within_radius;
+std::vector<int> LSH::rangeSearch(const unsigned char* query_point, double radius, int probes) {
+    std::vector<int> candidates_within_radius;
+    rangeSearch(query_point, radius, [&](int index, double) { candidates_within_radius.push_back(index); }, 0, probes);
 
-    //std::cout << "radius: " << radius << std::endl;
+    // Every point was reported once, so sorting is all that is left
+    std::sort(candidates_within_radius.begin(), candidates_within_radius.end());
+    return candidates_within_radius;
+}
 
+std::size_t LSH::rangeSearch(const unsigned char* query_point, double radius,
+                             const std::function<void(int, double)>& visit,
+                             std::size_t max_results, int probes) {
+    const std::uint64_t squared_radius = squaredRadius(radius);
+    const std::size_t limit = max_results > 0 ? max_results : std::numeric_limits<std::size_t>::max();
 
-    for (int table_index = 0; table_index < L; ++table_index) {
-        int query_id_value = computeID(query_point, table_index);
-        int hash_value = query_id_value % num_buckets;
+    //std::cout << "radius: " << radius << std::endl;
 
-        for (const auto& [candidate_index, id_value] : hash_tables[table_index][hash_value]) {
+    // Scratch reused by every query on this thread, so a search allocates nothing once warmed up
+    thread_local std::vector<std::pair<int, int64_t>> sequence;
+    thread_local std::vector<SplitSlots> split_slots;
+    thread_local std::vector<int> candidates;
+    thread_local std::vector<int> inserted_ids;
+    thread_local VisitedSet visited;
+    probeSequence(query_point, probes, sequence, split_slots);
+
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    visited.clear(base_size + num_inserted);
+    std::size_t reported = 0;
+    const std::function<void(int, double)> visit_inserted = [&](int id, double distance) {
+        visit(static_cast<int>(id + base_size), distance);
+    };
+    for (std::size_t p = 0; p < sequence.size() && reported < limit; ++p) {
+        const int table_index = sequence[p].first;
+        candidates.clear();
+        appendMatches(table_index, sequence[p].second, split_slots[table_index], candidates, visited);
+        splitInserted(candidates, inserted_ids);
+
+        reported += scanWithinRadius(dataset, query_point, candidates, squared_radius, visit, limit - reported);
+        reported += scanWithinRadius(insertedView(), query_point, inserted_ids, squared_radius, visit_inserted,
+                                     limit - reported);
+    }
+    return reported;
+}
 
-            if (id_value == query_id_value) {
-                double distance = euclideanDistance(dataset[candidate_index], query_point);
+DatasetView LSH::getDataset() const {
+    return dataset;
+}
 
-                if (distance <= radius) {  // Use the passed radius
-                    candidates_within_radius.insert(candidate_index);
-                }
-            }
-        }
+std::size_t LSH::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    std::size_t bytes = projections.capacity() * sizeof(float) + offsets.capacity() * sizeof(double)
+                        + ri_values.capacity() * sizeof(int) + removed.capacity()
+                        + quantized_projections.weights.capacity() * sizeof(std::int16_t)
+                        + quantized_projections.scales.capacity() * sizeof(float);
+    for (const HashTable& table : hash_tables) {
+        bytes += table.offsets.capacity() * sizeof(int) + table.entries.capacity() * sizeof(BucketEntry);
     }
-
-    std::vector<int> result(candidates_within_radius.begin(), candidates_within_radius.end());
-    return result;
+    // Delta maps: roughly a node (entry plus next pointer and cached hash) per entry, plus the bucket array
+    for (const auto& table_delta : delta) {
+        bytes += table_delta.size() * (sizeof(std::pair<const int, int>) + 2 * sizeof(void*))
+                 + table_delta.bucket_count() * sizeof(void*);
+    }
+    bytes += delta_log.capacity() * sizeof(BucketEntry);
+    bytes += inserted_points.size() * inserted_points.stride();
+    return bytes;
 }
 
-const std::vector<std::vector<unsigned char>>& LSH::getDataset() const {
-    return dataset;
+double LSH::bucketWidth() const {
+    return w;
 }
 
 int LSH::returnN() const {
@@ -3,58 +3,216 @@
 
 #include <vector>
 #include <random>
-
+#include <ostream>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include "dataset.h"
+#include "global_functions.h"
+#include "projection.h"
+
+// Queries may run concurrently with each other and with insert/remove/compact.
 class LSH {
 public:
-    explicit LSH(std::vector<std::vector<unsigned char>> dataset, int k = 4, int L = 5, int N = 1, double R = 10000);
+    // num_threads <= 0 builds the index with one thread per core. The index depends only on the seed,
+    // not on the thread count; by default the seed is drawn from std::random_device.
+    // bucket_width <= 0 draws w from [400, 500].
+    // HashArithmetic::Quantized hashes with int16 weights on integer multiply-add; buckets match the float
+    // hash except for points lying right at a slot boundary (see hashDisagreements).
+    // Each table gets n / load_factor buckets.
+    // Runs of points sharing an ID that are longer than split_threshold are split by one more hash function,
+    // so a query scans only part of them. Splitting trades some recall for shorter scans: 0 never splits,
+    // and a negative value picks max(64, 16 * load_factor).
+    explicit LSH(DatasetView dataset, int k = 4, int L = 5, int N = 1, double R = 10000,
+                 int num_threads = 0, unsigned int seed = std::random_device{}(), double bucket_width = 0,
+                 HashArithmetic arithmetic = HashArithmetic::Float, double load_factor = 4,
+                 int split_threshold = -1);
     ~LSH();
 
-    // Function to create hash functions
-    [[nodiscard]] std::vector<std::pair<std::vector<double>, double>> createHashFunctions(int nf, int nd) const;
+    LSH(const LSH&) = delete;
+    LSH& operator=(const LSH&) = delete;
 
-    // Overload 1: Doesn't take radius, uses the class's private member R
-    std::vector<int> rangeSearch(const std::vector<unsigned char>& query_point);
+    // Adds a point of the dataset's dimension and returns its index. Inserted points are numbered after
+    // the dataset's rows; their vectors are kept by this index alone, not added to the shared dataset, so
+    // other indexes over that dataset never see them.
+    int insert(const std::vector<unsigned char>& point);
+
+    // Removes a point from all future results (a tombstone until the next compaction).
+    // Returns false if the index is unknown or was already removed.
+    bool remove(int index);
 
-    // Overload 2: Takes a radius and uses that
-    std::vector<int> rangeSearch(const std::vector<unsigned char>& query_point, double radius);
+    // Folds inserted points into the compact tables and drops removed ones. Runs on its own in a
+    // background thread once enough updates pile up; queries and updates keep working meanwhile.
+    void compact();
 
-    // Function to query N nearest neighbors for a given query point
-    std::vector<std::pair<int, double>> queryNNearestNeighbors(const std::vector<unsigned char>& query_point,int K);
+    // Copy of the vector of any point, inserted or not. A copy, because inserts reallocate the storage
+    // of inserted points while other threads may hold on to the result.
+    [[nodiscard]] std::vector<unsigned char> point(int index) const;
+
+    // Overload 1: Doesn't take radius, uses the class's private member R
+    std::vector<int> rangeSearch(const unsigned char* query_point);
+
+    // Overload 2: Takes a radius and uses that, and optionally multi-probes (see below)
+    std::vector<int> rangeSearch(const unsigned char* query_point, double radius, int probes = 0);
+
+    // Streaming range search: calls visit(index, distance) for every point within radius as soon as it is
+    // measured, each point at most once and in no particular order, and stops after max_results hits
+    // (0 means no limit). Returns the number of hits reported. visit must not modify the index.
+    std::size_t rangeSearch(const unsigned char* query_point, double radius,
+                            const std::function<void(int, double)>& visit,
+                            std::size_t max_results = 0, int probes = 0);
+
+    // Function to query N nearest neighbors for a given query point.
+    // Each colliding point is measured once, however many tables it is found in. With max_candidates > 0,
+    // at most that many distinct candidates are examined (like Hypercube's M); 0 examines them all.
+    // probes > 0 enables multi-probe LSH: besides the query's own bucket in each table, up to `probes`
+    // more buckets are visited across all tables, those whose slots lie closest to the query first.
+    std::vector<std::pair<int, double>> queryNNearestNeighbors(const unsigned char* query_point, int K,
+                                                               int max_candidates = 0, int probes = 0);
 
     // Getter for N
     [[nodiscard]] int returnN() const;
     [[nodiscard]] double returnR() const;
 
-    // Function to get the dataset
-    const std::vector<std::vector<unsigned char>>& getDataset() const;
+    // Function to get the dataset (the original rows only, without inserted points)
+    [[nodiscard]] DatasetView getDataset() const;
+
+    // Number of points whose ID in some table differs between float and quantized hashing
+    [[nodiscard]] std::size_t hashDisagreements(DatasetView points) const;
+
+    // Bytes held by the index itself (tables, hash functions and inserted points), not the shared dataset
+    [[nodiscard]] std::size_t memoryUsage() const;
+    [[nodiscard]] double bucketWidth() const;
 
     // Function to print the hash tables
     void printHashTables();
 
+    // Per table: bucket count, longest bucket and ID run, split runs and a histogram of bucket sizes
+    void printBucketStatistics(std::ostream& out) const;
+
 private:
     int k; // Number of hash functions
     int L; // Number of hash tables
-    int num_buckets = 15000; // Number of buckets
+    double load_factor; // Target points per bucket
+    int num_buckets; // Number of buckets, n / load_factor
     int N; // Number of nearest neighbors
     double w; // Bucket width
     double R; // Radius
 
-    std::vector<std::vector<unsigned char>> dataset; // The dataset of points
+    DatasetView dataset; // The shared dataset of points (not owned)
     std::vector<int> ri_values; // Random coefficients
 
-    int num_dimensions = 784; // Number of dimensions of a data point
-
-    // to store both the index and the ID value.
-    std::vector<std::vector<std::vector<std::pair<int, int>>>> hash_tables;
-
-    // Hash functions for each table
-    std::vector<std::vector<std::pair<std::vector<double>, double>>> hash_functions;
+    int num_dimensions; // Number of dimensions of a data point, taken from the dataset
+    int num_threads; // Threads used to build the index
+
+    // One entry per point and table: the full ID value, the table's split hash and the point's index
+    struct BucketEntry {
+        int id_value;
+        int split_hash;
+        int index;
+    };
+
+    // Compressed (CSR) hash table: bucket b occupies entries[offsets[b], offsets[b + 1]),
+    // and the entries of each bucket are sorted by (ID value, split hash), so the points sharing the
+    // query's ID form one contiguous run that is found by binary search.
+    // Runs longer than split_threshold are refined by one more hash function per table (the split hash,
+    // as in an LSH forest): a query only scans the part of such a run that shares its split hash.
+    // The number of buckets is offsets.size() - 1.
+    struct HashTable {
+        std::vector<int> offsets;
+        std::vector<BucketEntry> entries;
+    };
+    std::vector<HashTable> hash_tables;
+    std::size_t split_threshold; // Longest ID run scanned whole (SIZE_MAX when runs are never split)
+
+    // Online updates. Points inserted since the last compaction live in per-table delta maps
+    // (ID value -> index); removed points stay in the tables, flagged in `removed`, until compaction.
+    std::size_t base_size; // Rows of the dataset; inserted points get the indices after them
+    Dataset inserted_points; // Vectors of inserted points, grown by doubling
+    std::size_t num_inserted = 0;
+    std::vector<std::unordered_multimap<int, int>> delta;
+    std::vector<BucketEntry> delta_log; // Delta entries of all tables in insertion order, L per point
+    std::vector<unsigned char> removed; // Tombstones, one per index
+    std::size_t pending_updates = 0; // Inserts and removals since the last compaction
+
+    mutable std::shared_mutex index_mutex; // Shared by queries, exclusive for updates
+    std::mutex compaction_mutex; // One compaction at a time
+    std::thread compaction_thread;
+    std::atomic<bool> compaction_running{false};
+
+    // Projection vectors v of all L*k hash functions, followed by the L split hash functions, packed into
+    // one row-major (L*(k+1)) x num_dimensions matrix, so a point is projected for every table in a single
+    // pass. Row table_index * k + i is function i of table table_index, row L*k + table_index is that
+    // table's split function; offsets holds the matching t values.
+    std::vector<float> projections;
+    std::vector<double> offsets;
+    HashArithmetic arithmetic;
+    QuantizedMatrix quantized_projections; // int16 copy of projections
+
+    // Projections of points [begin, end) on all L*k functions, in the given arithmetic
+    void project(DatasetView points, std::size_t begin, std::size_t end, float* out,
+                 HashArithmetic with) const;
+
+    // Draws v ~ N(0, 1) and t ~ U[0, w) for all L*k hash functions
+    void createHashFunctions(std::default_random_engine& generator);
 
     // Helper function to build the hash table index
     void buildIndex();
 
-    // Helper function to compute the ID value for a data point
-    int64_t computeID(const std::vector<unsigned char>& data_point, int table_index);
+    // Counting sort of all points into table_index, given every point's IDs and split hashes (n x L, row-major)
+    void buildTable(int table_index, const std::vector<int>& point_ids, const std::vector<int>& point_splits);
+
+    // Compact table of bucket_count buckets with the given entries, sorted by (ID, split hash, index)
+    // within each bucket
+    [[nodiscard]] static HashTable layoutTable(const std::vector<BucketEntry>& entries, int bucket_count);
+
+    // Bucket count for a number of points at the target load factor
+    [[nodiscard]] int bucketsFor(std::size_t points) const;
+
+    // Starts a background compaction if enough updates are pending; called with index_mutex held
+    void maybeStartCompaction();
+
+    // Vectors of inserted points, by index - base_size
+    [[nodiscard]] DatasetView insertedView() const;
+
+    // Moves the inserted points out of candidates into inserted_ids, as indices into insertedView()
+    void splitInserted(std::vector<int>& candidates, std::vector<int>& inserted_ids) const;
+
+    // Measures candidates, base and inserted alike, into nearest
+    void scanAll(const unsigned char* query, std::vector<int>& candidates, TopKHeap& nearest) const;
+
+    // ID value of one table, given the point's projections on all L*k functions
+    [[nodiscard]] int64_t idFromProjections(const float* point_projections, int table_index) const;
+
+    // A query's split hash in one table and the neighbouring split slot closer to it; split runs are
+    // scanned for both, which keeps most of the recall a whole-run scan would give
+    struct SplitSlots {
+        int own;
+        int nearest;
+    };
+
+    // Split hash of one table, given the point's projections on all functions
+    [[nodiscard]] SplitSlots splitFromProjections(const float* point_projections, int table_index) const;
+
+    // Rows of the projection matrix
+    [[nodiscard]] std::size_t functionCount() const { return static_cast<std::size_t>(L) * (k + 1); }
+
+    // ID value from the k (offset) slot numbers hi of one table
+    [[nodiscard]] int64_t idFromHashes(const int64_t* hashes) const;
+
+    // Buckets to visit for a query as (table, ID) pairs: the query's own ID in every table, then
+    // `probes` perturbed IDs in increasing order of the query's distance to the perturbed slots.
+    // split_slots receives the query's split slots in every table.
+    void probeSequence(const unsigned char* query_point, int probes,
+                       std::vector<std::pair<int, int64_t>>& sequence, std::vector<SplitSlots>& split_slots) const;
+
+    // Appends the live points of table_index whose ID equals id_value and that are not yet in visited.
+    // In a split run, only the points whose split hash is one of split_slots.
+    void appendMatches(int table_index, int64_t id_value, SplitSlots split_slots, std::vector<int>& candidates,
+                       VisitedSet& visited) const;
 };
 
 #endif
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <memory>
+#include <cstdint>
+#include <limits>
 
 #include "mnist.h"
 
@@ -22,7 +25,7 @@ auto reverseInt = [](int i) {
 };
 
 // Function to read and process MNIST image data
-std::vector<std::vector<unsigned char>> read_mnist_images(const std::string& full_path, int& number_of_images, int& image_size) {
+Dataset read_mnist_images(const std::string& full_path, int& number_of_images, int& image_size) {
 
     // std::cout << "Reading MNIST images from `" << full_path << "`..." << std::endl;
 
@@ -52,11 +55,11 @@ std::vector<std::vector<unsigned char>> read_mnist_images(const std::string& ful
         // Calculate image size
         image_size = n_rows * n_cols;
 
-        // Create a 2D vector to hold the image dataset
-        std::vector<std::vector<unsigned char>> dataset(number_of_images, std::vector<unsigned char>(image_size));
-        // Read image data into the dataset
+        // Create the flat, aligned store that holds the image dataset
+        Dataset dataset(number_of_images, image_size);
+        // Read image data into the dataset, one padded row per image
         for (int i = 0; i < number_of_images; i++) {
-            file.read(reinterpret_cast<char*>(&dataset[i][0]), image_size);
+            file.read(reinterpret_cast<char*>(dataset.mutableRow(i)), image_size);
         }
         return dataset;
     }
@@ -65,6 +68,49 @@ std::vector<std::vector<unsigned char>> read_mnist_images(const std::string& ful
     }
 }
 
+// Reads a big-endian 32-bit header field straight from the mapped bytes
+static std::uint32_t readBigEndian(const unsigned char* bytes) {
+    return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+           (static_cast<std::uint32_t>(bytes[2]) << 8) | static_cast<std::uint32_t>(bytes[3]);
+}
+
+Dataset map_mnist_images(const std::string& full_path, int& number_of_images, int& image_size, MappingHint hint) {
+    MappedFile file = mapFile(full_path, hint);
+
+    // idx magic number: two zero bytes, the element type (0x08 = unsigned byte) and the number of dimensions.
+    // MNIST image files (2051) are unsigned byte with three dimensions.
+    if (file.size < 4 || file.bytes[0] != 0 || file.bytes[1] != 0 || file.bytes[2] != 0x08)
+        throw std::runtime_error("Not valid MNIST file!");
+    const int num_dims = file.bytes[3];
+    const std::size_t header_size = 4 + 4 * static_cast<std::size_t>(num_dims);
+    if (num_dims < 2 || file.size < header_size)
+        throw std::runtime_error("Not valid MNIST file!");
+
+    const std::uint32_t rows = readBigEndian(file.bytes + 4);
+    if (rows > static_cast<std::uint32_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Not valid MNIST file!");
+    }
+    // Checked after every factor: a bound below 2^31 times a 32-bit dimension cannot overflow 64 bits
+    std::uint64_t row_size = 1;
+    for (int d = 1; d < num_dims; ++d) {
+        row_size *= readBigEndian(file.bytes + 4 + 4 * d);
+        if (row_size == 0 || row_size > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+            throw std::runtime_error("Not valid MNIST file!");
+        }
+    }
+
+    // The header must not promise more data than the file holds
+    if (rows * row_size > file.size - header_size) {
+        throw std::runtime_error("MNIST file `" + full_path + "` is truncated!");
+    }
+
+    number_of_images = static_cast<int>(rows);
+    image_size = static_cast<int>(row_size);
+
+    // Rows are stored back to back, so the data block is already a dataset with stride == row size
+    return Dataset::wrap(file.bytes + header_size, rows, row_size, row_size, std::move(file.owner));
+}
+
 // Helper function to print an image from the MNIST dataset
 void print_image(const std::vector<unsigned char>& image, int width, int height) {
     // Loop through each pixel of the image and print it to the console
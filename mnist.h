@@ -3,9 +3,16 @@
 
 #include <vector>
 #include <string>
+#include "dataset.h"
+#include "file_mapping.h"
 
 // Function declarations (signatures)
-std::vector<std::vector<unsigned char>> read_mnist_images(const std::string& full_path, int& number_of_images, int& image_size);
+Dataset read_mnist_images(const std::string& full_path, int& number_of_images, int& image_size);
+// Maps an unsigned-byte idx file (MNIST images or any other idx matrix with two or more dimensions)
+// read-only and exposes its data block directly, without copying or per-image allocation.
+// The first idx dimension gives the number of rows; the remaining ones multiply to the row size.
+Dataset map_mnist_images(const std::string& full_path, int& number_of_images, int& image_size,
+                         MappingHint hint = MappingHint::None);
 void print_image(const std::vector<unsigned char>& image, int width, int height);
 
 #endif
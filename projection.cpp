@@ -0,0 +1,246 @@
+#include "projection.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "cpu_features.h"
+
+// Points projected together; their rows stay in L1 while the matrix streams past once
+static constexpr std::size_t kPointGroup = 4;
+
+using ProjectGroupKernel = void (*)(const float* matrix, std::size_t rows, std::size_t dim,
+                                    const unsigned char* const points[kPointGroup], std::size_t count, float* out);
+using QuantizedGroupKernel = void (*)(const QuantizedMatrix& matrix, const unsigned char* const points[kPointGroup],
+                                      std::size_t count, float* out);
+
+static void projectGroupScalar(const float* matrix, std::size_t rows, std::size_t dim,
+                               const unsigned char* const points[kPointGroup], std::size_t count, float* out) {
+    for (std::size_t r = 0; r < rows; ++r) {
+        const float* v = matrix + r * dim;
+        for (std::size_t p = 0; p < count; ++p) {
+            float dot = 0.0f;
+            for (std::size_t j = 0; j < dim; ++j) {
+                dot += v[j] * static_cast<float>(points[p][j]);
+            }
+            out[p * rows + r] = dot;
+        }
+    }
+}
+
+static void projectGroupQuantizedScalar(const QuantizedMatrix& matrix, const unsigned char* const points[kPointGroup],
+                                        std::size_t count, float* out) {
+    const std::size_t rows = matrix.rows;
+    const std::size_t dim = matrix.dim;
+    for (std::size_t r = 0; r < rows; ++r) {
+        const std::int16_t* v = matrix.weights.data() + r * dim;
+        for (std::size_t p = 0; p < count; ++p) {
+            std::int32_t dot = 0;
+            for (std::size_t j = 0; j < dim; ++j) {
+                dot += v[j] * static_cast<std::int32_t>(points[p][j]);
+            }
+            out[p * rows + r] = static_cast<float>(dot) * matrix.scales[r];
+        }
+    }
+}
+
+#ifdef K23_X86
+
+__attribute__((target("avx2,fma")))
+static float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// Adds the components [start, dim) that did not fill a whole vector. Shared by the single-point and group
+// kernels (and kept out of line) so both round the tail identically.
+__attribute__((target("avx2,fma"), noinline))
+static float rowTail(const float* v, const unsigned char* point, std::size_t start, std::size_t dim, float dot) {
+    for (std::size_t t = start; t < dim; ++t) {
+        dot += v[t] * static_cast<float>(point[t]);
+    }
+    return dot;
+}
+
+__attribute__((target("avx2,fma")))
+static void projectGroupAVX2(const float* matrix, std::size_t rows, std::size_t dim,
+                             const unsigned char* const points[kPointGroup], std::size_t count, float* out) {
+    for (std::size_t r = 0; r < rows; ++r) {
+        const float* v = matrix + r * dim;
+        __m256 acc[kPointGroup] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        std::size_t j = 0;
+        for (; j + 8 <= dim; j += 8) {
+            __m256 m = _mm256_loadu_ps(v + j);
+            for (std::size_t p = 0; p < count; ++p) {
+                __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(points[p] + j));
+                __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+                acc[p] = _mm256_fmadd_ps(m, x, acc[p]);
+            }
+        }
+        for (std::size_t p = 0; p < count; ++p) {
+            out[p * rows + r] = rowTail(v, points[p], j, dim, horizontalSum(acc[p]));
+        }
+    }
+}
+
+// One point, four matrix rows at a time. Every row keeps a single accumulator fed in the same order as
+// projectGroupAVX2, so a point gets bit-identical projections from projectPoint and projectPoints;
+// interleaving rows instead of splitting one row's sum is what hides the FMA latency.
+__attribute__((target("avx2,fma")))
+static void projectOneAVX2(const float* matrix, std::size_t rows, std::size_t dim, const unsigned char* point,
+                           float* out) {
+    constexpr std::size_t kRowGroup = 4;
+    std::size_t r = 0;
+    for (; r + kRowGroup <= rows; r += kRowGroup) {
+        const float* v = matrix + r * dim;
+        __m256 acc[kRowGroup] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        std::size_t j = 0;
+        for (; j + 8 <= dim; j += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(point + j));
+            __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+            for (std::size_t g = 0; g < kRowGroup; ++g) {
+                acc[g] = _mm256_fmadd_ps(_mm256_loadu_ps(v + g * dim + j), x, acc[g]);
+            }
+        }
+        for (std::size_t g = 0; g < kRowGroup; ++g) {
+            out[r + g] = rowTail(v + g * dim, point, j, dim, horizontalSum(acc[g]));
+        }
+    }
+    // Leftover rows go through the group kernel itself
+    if (r < rows) {
+        const unsigned char* points[kPointGroup] = {point, point, point, point};
+        projectGroupAVX2(matrix + r * dim, rows - r, dim, points, 1, out + r);
+    }
+}
+
+__attribute__((target("avx2")))
+static std::int32_t horizontalSumEpi32(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// 16 weights per step: bytes widen to int16 and pmaddwd multiplies and adds pairs straight into int32 lanes
+__attribute__((target("avx2")))
+static void projectGroupQuantizedAVX2(const QuantizedMatrix& matrix, const unsigned char* const points[kPointGroup],
+                                      std::size_t count, float* out) {
+    const std::size_t rows = matrix.rows;
+    const std::size_t dim = matrix.dim;
+    for (std::size_t r = 0; r < rows; ++r) {
+        const std::int16_t* v = matrix.weights.data() + r * dim;
+        __m256i acc[kPointGroup] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                                    _mm256_setzero_si256(), _mm256_setzero_si256()};
+        std::size_t j = 0;
+        for (; j + 16 <= dim; j += 16) {
+            __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + j));
+            for (std::size_t p = 0; p < count; ++p) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points[p] + j));
+                acc[p] = _mm256_add_epi32(acc[p], _mm256_madd_epi16(m, _mm256_cvtepu8_epi16(bytes)));
+            }
+        }
+        for (std::size_t p = 0; p < count; ++p) {
+            std::int32_t dot = horizontalSumEpi32(acc[p]);
+            for (std::size_t t = j; t < dim; ++t) {
+                dot += v[t] * static_cast<std::int32_t>(points[p][t]);
+            }
+            out[p * rows + r] = static_cast<float>(dot) * matrix.scales[r];
+        }
+    }
+}
+
+#endif
+
+static ProjectGroupKernel selectedKernel() {
+    static const ProjectGroupKernel selected = [] {
+#ifdef K23_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return &projectGroupAVX2;
+        }
+#endif
+        return &projectGroupScalar;
+    }();
+    return selected;
+}
+
+static QuantizedGroupKernel selectedQuantizedKernel() {
+    static const QuantizedGroupKernel selected = [] {
+#ifdef K23_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return &projectGroupQuantizedAVX2;
+        }
+#endif
+        return &projectGroupQuantizedScalar;
+    }();
+    return selected;
+}
+
+void projectPoint(const float* matrix, std::size_t rows, std::size_t dim, const unsigned char* point, float* out) {
+#ifdef K23_X86
+    if (selectedKernel() == &projectGroupAVX2) {
+        projectOneAVX2(matrix, rows, dim, point, out);
+        return;
+    }
+#endif
+    const unsigned char* points[kPointGroup] = {point, point, point, point};
+    selectedKernel()(matrix, rows, dim, points, 1, out);
+}
+
+void projectPoints(const float* matrix, std::size_t rows, std::size_t dim, DatasetView points,
+                   std::size_t begin, std::size_t end, float* out) {
+    ProjectGroupKernel kernel = selectedKernel();
+    for (std::size_t p = begin; p < end; p += kPointGroup) {
+        const std::size_t count = std::min(kPointGroup, end - p);
+        const unsigned char* group[kPointGroup];
+        for (std::size_t g = 0; g < kPointGroup; ++g) {
+            group[g] = points.row(p + std::min(g, count - 1));
+        }
+        kernel(matrix, rows, dim, group, count, out + (p - begin) * rows);
+    }
+}
+
+QuantizedMatrix quantizeMatrix(const float* matrix, std::size_t rows, std::size_t dim) {
+    QuantizedMatrix quantized;
+    quantized.rows = rows;
+    quantized.dim = dim;
+    quantized.weights.resize(rows * dim);
+    quantized.scales.resize(rows);
+
+    // Largest weight magnitude for which dim * 255 * |weight| stays below 2^31
+    const double limit = std::min<double>(std::numeric_limits<std::int16_t>::max(),
+                                          std::floor((std::numeric_limits<std::int32_t>::max() - 1.0) /
+                                                     (255.0 * std::max<std::size_t>(dim, 1))));
+    for (std::size_t r = 0; r < rows; ++r) {
+        const float* v = matrix + r * dim;
+        float largest = 0.0f;
+        for (std::size_t j = 0; j < dim; ++j) {
+            largest = std::max(largest, std::fabs(v[j]));
+        }
+        const double scale = largest > 0.0f ? largest / limit : 1.0;
+        quantized.scales[r] = static_cast<float>(scale);
+        for (std::size_t j = 0; j < dim; ++j) {
+            quantized.weights[r * dim + j] = static_cast<std::int16_t>(std::lround(v[j] / scale));
+        }
+    }
+    return quantized;
+}
+
+void projectPointQuantized(const QuantizedMatrix& matrix, const unsigned char* point, float* out) {
+    const unsigned char* points[kPointGroup] = {point, point, point, point};
+    selectedQuantizedKernel()(matrix, points, 1, out);
+}
+
+void projectPointsQuantized(const QuantizedMatrix& matrix, DatasetView points,
+                            std::size_t begin, std::size_t end, float* out) {
+    QuantizedGroupKernel kernel = selectedQuantizedKernel();
+    for (std::size_t p = begin; p < end; p += kPointGroup) {
+        const std::size_t count = std::min(kPointGroup, end - p);
+        const unsigned char* group[kPointGroup];
+        for (std::size_t g = 0; g < kPointGroup; ++g) {
+            group[g] = points.row(p + std::min(g, count - 1));
+        }
+        kernel(matrix, group, count, out + (p - begin) * matrix.rows);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PROJECT_K23_SEC_PROJECTION_H
+#define PROJECT_K23_SEC_PROJECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dataset.h"
+
+//
+// Dense float projections of uint8 points, used for hashing.
+// The matrix is row-major, `rows` x `dim`; row r is one projection vector.
+//
+
+// out[r] = <matrix row r, point>. Bit-identical to the point's row from projectPoints, so a dataset row
+// used as a query hashes exactly as it did at build time.
+void projectPoint(const float* matrix, std::size_t rows, std::size_t dim, const unsigned char* point, float* out);
+
+// Projects points [begin, end) of the dataset: out[(p - begin) * rows + r] = <matrix row r, point p>.
+// Points are processed in small groups, so every matrix row is loaded once per group rather than once per point.
+void projectPoints(const float* matrix, std::size_t rows, std::size_t dim, DatasetView points,
+                   std::size_t begin, std::size_t end, float* out);
+
+// How the hash projections are computed: float weights, or int16 weights on integer multiply-add
+enum class HashArithmetic { Float, Quantized };
+
+// Projection matrix with int16 weights: row r is approximately weights[r] * scales[r].
+// Each row is scaled so that dim * 255 * max|weight| < 2^31, hence a whole dot product with uint8 data
+// accumulates exactly in int32; the only error is the rounding of the weights.
+struct QuantizedMatrix {
+    std::vector<std::int16_t> weights; // Row-major, rows x dim
+    std::vector<float> scales;
+    std::size_t rows = 0;
+    std::size_t dim = 0;
+};
+
+QuantizedMatrix quantizeMatrix(const float* matrix, std::size_t rows, std::size_t dim);
+
+// Same as projectPoint / projectPoints, with the quantized weights
+void projectPointQuantized(const QuantizedMatrix& matrix, const unsigned char* point, float* out);
+void projectPointsQuantized(const QuantizedMatrix& matrix, DatasetView points,
+                            std::size_t begin, std::size_t end, float* out);
+
+#endif //PROJECT_K23_SEC_PROJECTION_H
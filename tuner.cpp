@@ -0,0 +1,188 @@
+#include "tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <unordered_set>
+#include "lsh_class.h"
+#include "Hypercube.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void checkTruth(DatasetView queries, const std::vector<std::vector<std::pair<int, double>>>& truth, int K) {
+    if (truth.size() < queries.size()) {
+        throw std::invalid_argument("Ground truth is missing for some queries.");
+    }
+    for (std::size_t q = 0; q < queries.size(); ++q) {
+        if (truth[q].size() < static_cast<std::size_t>(K)) {
+            throw std::invalid_argument("Ground truth has fewer than K neighbors.");
+        }
+    }
+}
+
+// Runs search on every query, filling in recall@K and the mean query time
+template <typename Search>
+void evaluate(DatasetView queries, const std::vector<std::vector<std::pair<int, double>>>& truth, int K,
+              Search search, TunedConfiguration& configuration) {
+    double hits = 0;
+    double seconds = 0;
+    std::unordered_set<int> expected;
+    for (std::size_t q = 0; q < queries.size(); ++q) {
+        auto start = Clock::now();
+        std::vector<std::pair<int, double>> results = search(queries.row(q));
+        seconds += secondsSince(start);
+
+        expected.clear();
+        for (int j = 0; j < K; ++j) {
+            expected.insert(truth[q][j].first);
+        }
+        for (std::size_t j = 0; j < results.size() && j < static_cast<std::size_t>(K); ++j) {
+            hits += static_cast<double>(expected.count(results[j].first));
+        }
+    }
+    configuration.recall = hits / (static_cast<double>(K) * queries.size());
+    configuration.seconds_per_query = seconds / queries.size();
+}
+
+} // namespace
+
+std::vector<TunedConfiguration> tuneLSH(DatasetView dataset, DatasetView queries,
+                                        const std::vector<std::vector<std::pair<int, double>>>& truth,
+                                        const TuningOptions& options) {
+    checkTruth(queries, truth, options.K);
+    std::vector<TunedConfiguration> configurations;
+    for (int k : options.lsh_k) {
+        for (double w : options.lsh_w) {
+            for (int L : options.lsh_L) {
+                auto build_start = Clock::now();
+                LSH lsh(dataset, k, L, 1, 10000, options.num_threads, options.seed, w);
+                double build_seconds = secondsSince(build_start);
+
+                bool met_without_probes = false;
+                for (std::size_t p = 0; p < options.lsh_probes.size(); ++p) {
+                    TunedConfiguration configuration;
+                    configuration.method = "LSH";
+                    configuration.k = k;
+                    configuration.L = L;
+                    configuration.w = w;
+                    configuration.probes = options.lsh_probes[p];
+                    configuration.build_seconds = build_seconds;
+                    configuration.memory_bytes = lsh.memoryUsage();
+                    evaluate(queries, truth, options.K, [&](const unsigned char* query) {
+                        return lsh.queryNNearestNeighbors(query, options.K, 0, configuration.probes);
+                    }, configuration);
+                    configurations.push_back(configuration);
+
+                    if (configuration.recall >= options.target_recall) {
+                        met_without_probes = p == 0;
+                        break;
+                    }
+                }
+                // More tables would only be slower
+                if (met_without_probes) {
+                    break;
+                }
+            }
+        }
+    }
+    return configurations;
+}
+
+std::vector<TunedConfiguration> tuneHypercube(DatasetView dataset, DatasetView queries,
+                                              const std::vector<std::vector<std::pair<int, double>>>& truth,
+                                              const TuningOptions& options) {
+    checkTruth(queries, truth, options.K);
+    std::vector<TunedConfiguration> configurations;
+    for (int k : options.cube_k) {
+        auto build_start = Clock::now();
+        Hypercube cube(dataset, k, 1, 1, 1, 10000, options.seed, options.cube_w);
+        double build_seconds = secondsSince(build_start);
+
+        for (int M : options.cube_M) {
+            for (int probes : options.cube_probes) {
+                cube.setSearchParameters(M, probes);
+
+                TunedConfiguration configuration;
+                configuration.method = "Hypercube";
+                configuration.k = k;
+                configuration.w = cube.bucketWidth();
+                configuration.M = M;
+                configuration.probes = probes;
+                configuration.build_seconds = build_seconds;
+                configuration.memory_bytes = cube.memoryUsage();
+                evaluate(queries, truth, options.K, [&](const unsigned char* query) {
+                    return cube.kNearestNeighbors(query, options.K);
+                }, configuration);
+                configurations.push_back(configuration);
+
+                if (configuration.recall >= options.target_recall) {
+                    break;
+                }
+            }
+        }
+    }
+    return configurations;
+}
+
+const TunedConfiguration* fastestMeetingTarget(const std::vector<TunedConfiguration>& configurations,
+                                               double target_recall) {
+    const TunedConfiguration* best = nullptr;
+    for (const TunedConfiguration& configuration : configurations) {
+        if (configuration.recall >= target_recall &&
+            (best == nullptr || configuration.seconds_per_query < best->seconds_per_query)) {
+            best = &configuration;
+        }
+    }
+    return best;
+}
+
+namespace {
+
+void printConfiguration(std::ostream& out, const TunedConfiguration& c) {
+    out << std::left << std::setw(10) << c.method << std::right
+        << " k=" << std::setw(2) << c.k;
+    if (c.method == "LSH") {
+        out << " L=" << std::setw(2) << c.L;
+    } else {
+        out << " M=" << std::setw(5) << c.M;
+    }
+    out << " w=" << std::fixed << std::setprecision(1) << std::setw(6) << c.w
+        << " probes=" << std::setw(3) << c.probes
+        << " recall=" << std::setprecision(3) << c.recall
+        << " query=" << std::setprecision(1) << c.seconds_per_query * 1e6 << "us"
+        << " build=" << std::setprecision(2) << c.build_seconds << "s"
+        << " memory=" << std::setprecision(1) << c.memory_bytes / (1024.0 * 1024.0) << "MiB"
+        << std::defaultfloat << std::endl;
+}
+
+} // namespace
+
+void printTuningReport(std::ostream& out, const std::vector<TunedConfiguration>& configurations,
+                       double target_recall) {
+    for (const TunedConfiguration& configuration : configurations) {
+        printConfiguration(out, configuration);
+    }
+
+    for (const char* method : {"LSH", "Hypercube"}) {
+        std::vector<TunedConfiguration> of_method;
+        std::copy_if(configurations.begin(), configurations.end(), std::back_inserter(of_method),
+                     [&](const TunedConfiguration& c) { return c.method == method; });
+        if (of_method.empty()) {
+            continue;
+        }
+        out << std::endl << "Best " << method << " for recall >= " << target_recall << ": ";
+        const TunedConfiguration* best = fastestMeetingTarget(of_method, target_recall);
+        if (best == nullptr) {
+            out << "none of the configurations reached the target" << std::endl;
+        } else {
+            out << std::endl;
+            printConfiguration(out, *best);
+        }
+    }
+}
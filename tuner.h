@@ -0,0 +1,63 @@
+#ifndef PROJECT_K23_SEC_TUNER_H
+#define PROJECT_K23_SEC_TUNER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dataset.h"
+
+// Parameter grids searched by the tuner. Grids are walked in increasing order, and for every build the
+// query-time parameters stop growing once the target is met, since larger values only cost time.
+struct TuningOptions {
+    int K = 1; // Neighbors per query; recall is measured as recall@K
+    double target_recall = 0.9;
+
+    std::vector<int> lsh_k{2, 4, 6, 8};
+    std::vector<int> lsh_L{1, 2, 4, 8};
+    std::vector<double> lsh_w{200, 450, 800};
+    std::vector<int> lsh_probes{0, 8, 32}; // Extra multi-probe buckets per query
+
+    std::vector<int> cube_k{8, 10, 12, 14};
+    std::vector<int> cube_M{500, 2000, 6000};
+    std::vector<int> cube_probes{2, 10, 50};
+    double cube_w = 0; // <= 0 keeps Hypercube's random w
+
+    int num_threads = 0; // Build threads for LSH (<= 0 means one per core)
+    unsigned int seed = 1; // Every configuration is built from the same seed
+};
+
+// One evaluated configuration. Fields that do not apply to the method are 0.
+struct TunedConfiguration {
+    std::string method; // "LSH" or "Hypercube"
+    int k = 0;
+    int L = 0;
+    double w = 0;
+    int M = 0;
+    int probes = 0;
+    double recall = 0; // Mean recall@K over the query sample
+    double seconds_per_query = 0;
+    double build_seconds = 0;
+    std::size_t memory_bytes = 0; // Index only, without the shared dataset
+};
+
+// Grid searches over (k, L, w, probes) for LSH and (k, M, probes) for Hypercube, evaluating each
+// configuration on the query sample against its exact neighbors (truth[q] for queries row q, as returned
+// by exactKNearestNeighbors or cachedGroundTruth with at least K neighbors).
+std::vector<TunedConfiguration> tuneLSH(DatasetView dataset, DatasetView queries,
+                                        const std::vector<std::vector<std::pair<int, double>>>& truth,
+                                        const TuningOptions& options);
+std::vector<TunedConfiguration> tuneHypercube(DatasetView dataset, DatasetView queries,
+                                              const std::vector<std::vector<std::pair<int, double>>>& truth,
+                                              const TuningOptions& options);
+
+// Fastest configuration that reaches the target recall, or nullptr if none does
+const TunedConfiguration* fastestMeetingTarget(const std::vector<TunedConfiguration>& configurations,
+                                               double target_recall);
+
+// Table of all configurations followed by the recommended one for each method
+void printTuningReport(std::ostream& out, const std::vector<TunedConfiguration>& configurations,
+                       double target_recall);
+
+#endif //PROJECT_K23_SEC_TUNER_H
@@ -0,0 +1,155 @@
+#include "vecs_io.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "mnist.h"
+
+// Row count and dimension of a vecs file whose components are element_size bytes wide.
+// Every record's header is checked, so a file with mixed dimensions is rejected before any row is read.
+static void vecsLayout(const MappedFile& file, const std::string& path, std::size_t element_size,
+                       std::size_t& rows, std::size_t& dimension) {
+    if (file.size == 0) {
+        rows = 0;
+        dimension = 0;
+        return;
+    }
+    std::int32_t header = 0;
+    if (file.size < sizeof(header)) {
+        throw std::runtime_error("Not valid vecs file `" + path + "`!");
+    }
+    std::memcpy(&header, file.bytes, sizeof(header));
+    if (header <= 0) {
+        throw std::runtime_error("Not valid vecs file `" + path + "`!");
+    }
+    dimension = static_cast<std::size_t>(header);
+    const std::size_t record_size = sizeof(header) + dimension * element_size;
+    if (file.size % record_size != 0) {
+        throw std::runtime_error("Vecs file `" + path + "` is truncated or has mixed dimensions!");
+    }
+    rows = file.size / record_size;
+    for (std::size_t i = 1; i < rows; ++i) {
+        std::memcpy(&header, file.bytes + i * record_size, sizeof(header));
+        if (header != static_cast<std::int32_t>(dimension)) {
+            throw std::runtime_error("Vecs file `" + path + "` has mixed dimensions (record "
+                                     + std::to_string(i) + ")!");
+        }
+    }
+}
+
+Dataset map_bvecs(const std::string& path, MappingHint hint) {
+    MappedFile file = mapFile(path, hint);
+    std::size_t rows, dimension;
+    vecsLayout(file, path, 1, rows, dimension);
+    if (rows == 0) {
+        return Dataset();
+    }
+    // Every row is preceded by its 4-byte dimension, which the stride simply steps over
+    return Dataset::wrap(file.bytes + sizeof(std::int32_t), rows, dimension, sizeof(std::int32_t) + dimension,
+                         std::move(file.owner));
+}
+
+// Copies float/int components into uint8 rows; a component that is not an integer in [0, 255] is an error
+template <typename T>
+static Dataset readVecsAsUint8(const std::string& path) {
+    MappedFile file = mapFile(path, MappingHint::Sequential);
+    std::size_t rows, dimension;
+    vecsLayout(file, path, sizeof(T), rows, dimension);
+
+    Dataset dataset(rows, dimension);
+    const std::size_t record_size = sizeof(std::int32_t) + dimension * sizeof(T);
+    for (std::size_t i = 0; i < rows; ++i) {
+        const unsigned char* record = file.bytes + i * record_size;
+        unsigned char* row = dataset.mutableRow(i);
+        for (std::size_t j = 0; j < dimension; ++j) {
+            T value;
+            std::memcpy(&value, record + sizeof(std::int32_t) + j * sizeof(T), sizeof(T));
+            const double component = static_cast<double>(value);
+            if (!(component >= 0.0 && component <= 255.0 && component == std::floor(component))) {
+                throw std::runtime_error("Vecs file `" + path + "` has component " + std::to_string(component)
+                                         + " (row " + std::to_string(i) + ", column " + std::to_string(j)
+                                         + ") that is not an integer in [0, 255]; only uint8 data is supported!");
+            }
+            row[j] = static_cast<unsigned char>(component);
+        }
+    }
+    return dataset;
+}
+
+Dataset read_fvecs_as_uint8(const std::string& path) {
+    return readVecsAsUint8<float>(path);
+}
+
+Dataset read_ivecs_as_uint8(const std::string& path) {
+    return readVecsAsUint8<std::int32_t>(path);
+}
+
+template <typename T>
+static std::vector<std::vector<T>> readVecs(const std::string& path) {
+    MappedFile file = mapFile(path, MappingHint::Sequential);
+    std::vector<std::vector<T>> rows;
+    std::size_t offset = 0;
+    while (offset < file.size) {
+        std::int32_t dimension;
+        if (file.size - offset < sizeof(dimension)) {
+            throw std::runtime_error("Vecs file `" + path + "` is truncated!");
+        }
+        std::memcpy(&dimension, file.bytes + offset, sizeof(dimension));
+        offset += sizeof(dimension);
+        if (dimension < 0 || file.size - offset < dimension * sizeof(T)) {
+            throw std::runtime_error("Vecs file `" + path + "` is truncated!");
+        }
+        rows.emplace_back(dimension);
+        std::memcpy(rows.back().data(), file.bytes + offset, dimension * sizeof(T));
+        offset += dimension * sizeof(T);
+    }
+    return rows;
+}
+
+template <typename T>
+static void writeVecs(const std::string& path, const std::vector<std::vector<T>>& rows) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file `" + path + "` for writing!");
+    }
+    for (const auto& row : rows) {
+        auto dimension = static_cast<std::int32_t>(row.size());
+        file.write(reinterpret_cast<const char*>(&dimension), sizeof(dimension));
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(T)));
+    }
+    if (!file) {
+        throw std::runtime_error("Could not write file `" + path + "`!");
+    }
+}
+
+std::vector<std::vector<int>> read_ivecs(const std::string& path) {
+    return readVecs<int>(path);
+}
+
+std::vector<std::vector<float>> read_fvecs(const std::string& path) {
+    return readVecs<float>(path);
+}
+
+void write_ivecs(const std::string& path, const std::vector<std::vector<int>>& rows) {
+    writeVecs(path, rows);
+}
+
+void write_fvecs(const std::string& path, const std::vector<std::vector<float>>& rows) {
+    writeVecs(path, rows);
+}
+
+static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+Dataset load_dataset(const std::string& path, MappingHint hint) {
+    if (endsWith(path, ".bvecs")) {
+        return map_bvecs(path, hint);
+    }
+    if (endsWith(path, ".fvecs") || endsWith(path, ".ivecs")) {
+        return endsWith(path, ".fvecs") ? read_fvecs_as_uint8(path) : read_ivecs_as_uint8(path);
+    }
+    int number_of_rows, row_size;
+    return map_mnist_images(path, number_of_rows, row_size, hint);
+}
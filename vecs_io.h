@@ -0,0 +1,34 @@
+#ifndef PROJECT_K23_SEC_VECS_IO_H
+#define PROJECT_K23_SEC_VECS_IO_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "dataset.h"
+#include "file_mapping.h"
+
+//
+// TEXMEX vector files (.bvecs, .fvecs, .ivecs), as used by SIFT1M, GIST1M and most ANN benchmarks.
+// Every vector is stored as a little-endian int32 dimension followed by its components
+// (uint8, float32 or int32 respectively). All vectors in a file must have the same dimension.
+//
+
+// Maps a .bvecs file and exposes its rows in place (stride = 4 + dimension), without copying
+Dataset map_bvecs(const std::string& path, MappingHint hint = MappingHint::None);
+
+// The indexes work on uint8 vectors, so .fvecs/.ivecs files are accepted only when every component is an
+// integer in [0, 255] (e.g. SIFT stored as floats). Anything else (GIST, signed or real-valued embeddings)
+// throws std::runtime_error rather than being quantized into a different dataset.
+Dataset read_fvecs_as_uint8(const std::string& path);
+Dataset read_ivecs_as_uint8(const std::string& path);
+
+// Plain readers/writers for .ivecs/.fvecs matrices (e.g. ground-truth ids and distances)
+std::vector<std::vector<int>> read_ivecs(const std::string& path);
+std::vector<std::vector<float>> read_fvecs(const std::string& path);
+void write_ivecs(const std::string& path, const std::vector<std::vector<int>>& rows);
+void write_fvecs(const std::string& path, const std::vector<std::vector<float>>& rows);
+
+// Picks the loader from the file extension: .bvecs, .fvecs or .ivecs, anything else is read as idx.
+Dataset load_dataset(const std::string& path, MappingHint hint = MappingHint::None);
+
+#endif //PROJECT_K23_SEC_VECS_IO_H